@@ -32,8 +32,11 @@
 
 #ifdef _WIN32
 #include<windows.h>
+#include<winioctl.h>
 #endif
 
+#include "libbytes_internal.h"
+
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <stdio.h>
@@ -41,8 +44,40 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
-#include <fstream>
+#include <signal.h>
+#include <math.h>
+#include <stdint.h>
 #include <climits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+#include <conio.h>
+#else
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #ifdef BYTES_LITTLE_ENDIAN
 #undef BYTES_LITTLE_ENDIAN
@@ -54,31 +89,92 @@
 #endif
 #define BYTES_BIG_ENDIAN        2
 
-#define BYTES_DEF_NUM_COLS      20
 #define BYTES_DEF_NUM_LINES     15
 
-#define BYTES_DECIMAL_FORMAT    0
-#define BYTES_HEX_FORMAT        1
+// Parallel CRC: each worker reads its share of the file in blocks of this
+// size, and files are cut into pieces of this size for load balancing.
+#define BYTES_THREAD_BLOCK_SZ   (4 * 1024 * 1024)
+#define BYTES_THREAD_PIECE_SZ   (64LL * 1024 * 1024)
+
+// Input: regular files are mapped this much at a time, everything else is
+// read through a buffer of BYTES_READ_BUFF_SZ, which is also the largest
+// piece ByteSource::Next() hands out at once.
+#define BYTES_MAP_WINDOW_SZ     (sizeof(void*) >= 8 ? 1024LL * 1024 * 1024 : 64LL * 1024 * 1024)
+#define BYTES_READ_BUFF_SZ      (4 * 1024 * 1024)
+
+// Files smaller than this are read rather than mapped; one read into the
+// reusable buffer is cheaper than setting up and tearing down a mapping.
+#define BYTES_MIN_MAP_SZ        (256 * 1024)
+
+// Batch CRC: consecutive small files are handed to a worker together until
+// they add up to this many bytes or files.
+#define BYTES_BATCH_BYTES       (16LL * 1024 * 1024)
+#define BYTES_BATCH_FILES       256
+
+// Search patterns this long or longer use Horspool's skip loop; patterns
+// may be up to BYTES_SEARCH_MAX_LEN bytes.
+#define BYTES_HORSPOOL_MIN_LEN  128
+#define BYTES_SEARCH_MAX_LEN    (64 * 1024)
+
+// Block size for -p when none is given, and the largest allowed
+#define BYTES_DEF_PROFILE_BLOCK_SZ  (1024 * 1024)
+#define BYTES_MAX_PROFILE_BLOCK_SZ  (1024LL * 1024 * 1024)
+
+// Block manifests (-M, -V): block size when none is given, the largest
+// allowed, and the suffix of the manifest written next to each file
+#define BYTES_DEF_MANIFEST_BLOCK_SZ (1024 * 1024)
+#define BYTES_MAX_MANIFEST_BLOCK_SZ (1024LL * 1024 * 1024)
+#define BYTES_MANIFEST_EXT          ".crcs"
+
+// Duplicate chunk report (-u): average chunk size when none is given, and
+// the smallest and largest allowed
+#define BYTES_DEF_CHUNK_SZ          (16 * 1024)
+#define BYTES_MIN_CHUNK_SZ          256
+#define BYTES_MAX_CHUNK_SZ          (16 * 1024 * 1024)
+
+// Follow mode (-f) looks at the file at least this often
+#define BYTES_FOLLOW_POLL_MS        250
+
+// Formatted text is collected in a buffer of this size between writes
+#define BYTES_OUT_BUFF_SZ       (1024 * 1024)
+
+// A pipelined dump (-j) reads and formats blocks of about this many bytes
+#define BYTES_PIPE_BLOCK_SZ     (256 * 1024)
 
 #define BYTES_EIGHT_BIT_ASCII   0
-#define BYTES_UNICODE           1
+#define BYTES_UNICODE           1     // UTF-16, byte order from the BOM
+#define BYTES_UTF16LE           2
+#define BYTES_UTF16BE           3
+#define BYTES_UTF8              4
 
 static int g_endianness;
-static int g_numberFormat       = BYTES_DECIMAL_FORMAT;
 static int g_textEncoding       = BYTES_EIGHT_BIT_ASCII;
-static int g_numColWidth        = BYTES_DEF_NUM_COLS;
+static BytesConfig g_config;      // Row layout: -w and -x
 static long long g_linesToPrint   = BYTES_DEF_NUM_LINES;
+static int g_numThreads         = 1;
 static bool g_reportEndianness  = false;
-static bool g_compute16BitCRC   = false;
-static bool g_compute32BitCRC   = false;
-
-/* Table of CRCs of all 8-bit messages. */
-unsigned long g_crc16Table[256];
-unsigned long g_crc32Table[256];
-
-/* Flag: has the table been computed? Initially false. */
-static bool g_is16BitCRCTableComputed = false;
-static bool g_is32BitCRCTableComputed = false;
+static bool g_computeCRC        = false;
+static bool g_batchCRC          = false;
+static bool g_printProgress     = true;
+static bool g_printStats        = false;
+static bool g_collapseHoles     = false;
+static bool g_searchDump        = false;
+static const char* g_crcKernelName = NULL;
+static const char* g_crcAlgorithmName = NULL;
+static const char* g_searchArg  = NULL;
+static bool g_searchArgIsHex    = false;
+static bool g_scanSignatures    = false;
+static bool g_compareFiles      = false;
+static long long g_profileBlockSz = 0;
+static long long g_manifestBlockSz = 0;
+static bool g_verifyManifests   = false;
+static bool g_followFile        = false;
+static const char* g_rangeList  = NULL;
+static const char* g_rangeFile  = NULL;
+static bool g_interactive       = false;
+static long long g_chunkAvgSz   = 0;
+static const char* g_signatureFile = NULL;
+static std::vector<unsigned char> g_searchPattern;
 
 using namespace std;
 
@@ -95,16 +191,174 @@ public:
 #ifdef _WIN32
         strcpy_s(msg, str);
 #else
-        strncpy(msg, str, strlen(str));
+        strncpy(msg, str, sizeof(msg) - 1);
+        msg[sizeof(msg) - 1] = 0;
 #endif
     }
 };
 
 void HandleFileIOErr(char* filePath);
 
+/***************************************************************************
+   Run statistics for --stats. Time is split into the phases below; each
+   phase keeps the wall time and the CPU time of the threads that were in
+   it, so with several threads a phase can add up to more than the wall
+   time of the run. Mapped input has its pages read in on first touch,
+   which is counted in whichever phase touches them first (usually
+   compute or format), not in read.
+***************************************************************************/
+
+#define BYTES_PHASE_READ        0
+#define BYTES_PHASE_COMPUTE     1
+#define BYTES_PHASE_FORMAT      2
+#define BYTES_PHASE_WRITE       3
+#define BYTES_NUM_PHASES        4
+
+struct RunStats
+{
+    std::atomic<long long>  bytesProcessed;
+    std::atomic<long long>  readCalls;
+    std::atomic<long long>  bytesRead;
+    std::atomic<long long>  mapCalls;
+    std::atomic<long long>  wallNs[BYTES_NUM_PHASES];
+    std::atomic<long long>  cpuNs[BYTES_NUM_PHASES];
+};
+
+static RunStats g_stats;
+static std::chrono::steady_clock::time_point g_runStartTime;
+
+// CPU time used so far by the calling thread, or by the whole process
+long long ThreadCpuNs()
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+        return 0;
+    return ((((long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+            (((long long)user.dwHighDateTime << 32) | user.dwLowDateTime)) * 100;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+long long ProcessCpuNs()
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0;
+    return ((((long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+            (((long long)user.dwHighDateTime << 32) | user.dwLowDateTime)) * 100;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return ((long long)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL +
+           ((long long)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+#endif
+}
+
+/***************************************************************************
+   Charges the time from construction to destruction to one phase. Timers
+   nest: an inner timer pauses the one around it on the same thread, so
+   e.g. output flushed in the middle of formatting counts as write, not
+   format. Does nothing unless --stats was given.
+***************************************************************************/
+
+class PhaseTimer
+{
+public:
+    PhaseTimer(int phase)
+    {
+        m_on = g_printStats;
+        if (!m_on)
+            return;
+        m_phase = phase;
+        m_outer = s_current;
+        if (m_outer != NULL)
+            m_outer->Pause();
+        s_current = this;
+        Resume();
+    }
+
+    ~PhaseTimer()
+    {
+        if (!m_on)
+            return;
+        Pause();
+        s_current = m_outer;
+        if (m_outer != NULL)
+            m_outer->Resume();
+    }
+
+private:
+    void Resume()
+    {
+        m_wallStart = std::chrono::steady_clock::now();
+        m_cpuStart = ThreadCpuNs();
+    }
+
+    void Pause()
+    {
+        g_stats.wallNs[m_phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_wallStart).count();
+        g_stats.cpuNs[m_phase] += ThreadCpuNs() - m_cpuStart;
+    }
+
+    bool            m_on;
+    int             m_phase;
+    PhaseTimer*     m_outer;
+    std::chrono::steady_clock::time_point m_wallStart;
+    long long       m_cpuStart;
+
+    static thread_local PhaseTimer* s_current;
+};
+
+thread_local PhaseTimer* PhaseTimer::s_current = NULL;
+
+static inline void CountProcessed(long long bytes)
+{
+    if (g_printStats)
+        g_stats.bytesProcessed += bytes;
+}
+
+/***************************************************************************
+   Print the statistics to stderr. Registered with atexit() when --stats is
+   given, so it runs however the program finishes.
+***************************************************************************/
+
+void PrintStats()
+{
+    static const char* phaseNames[BYTES_NUM_PHASES] = { "Read", "Compute", "Format", "Write" };
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - g_runStartTime).count();
+    long long bytes = g_stats.bytesProcessed, reads = g_stats.readCalls;
+
+    fflush(stdout);
+    fprintf(stderr, "\n  Statistics:\n");
+    fprintf(stderr, "    Bytes processed:  %lld\n", bytes);
+    fprintf(stderr, "    Wall time:        %.3f s\n", wall);
+    fprintf(stderr, "    CPU time:         %.3f s\n", ProcessCpuNs() / 1e9);
+    for (int p = 0; p < BYTES_NUM_PHASES; p++)
+    {
+        fprintf(stderr, "    %-8s wall:    %.3f s, cpu: %.3f s\n", phaseNames[p],
+            g_stats.wallNs[p] / 1e9, g_stats.cpuNs[p] / 1e9);
+    }
+    fprintf(stderr, "    Read calls:       %lld (average %.0f bytes), map calls: %lld\n",
+        reads, reads > 0 ? (double)g_stats.bytesRead / reads : 0.0, (long long)g_stats.mapCalls);
+    fprintf(stderr, "    Throughput:       %.1f MB/s\n", wall > 0 ? bytes / wall / 1e6 : 0.0);
+}
+
 #ifndef _WIN32
 
 #define _stat64 stat64
+#define _fstat64 fstat64
+#define _open open
+#define _read read
+#define _fileno fileno
+#define _close close
+#define _O_RDONLY O_RDONLY
+#define _O_BINARY 0
 
 char* strerror_s(char* buff, int buffSz, int errNum)
 {
@@ -161,7 +415,7 @@ void PrintUsage()
 {
     fprintf(stderr,
         "\n\
-         Usage:  bytes [-xUecwl] fileneme [start] [end]\n\n\
+         Usage:  bytes [-xUecCwlakjmMVfrRiuHsSdgDp] fileneme [start] [end]\n\n\
          Prints the ASCII char values as unsigned ints (0-255) of each character\n\
          in the specified file and their character representation, if printable.\n\
          o Works identically on all file types - text and binary.\n\
@@ -171,13 +425,70 @@ void PrintUsage()
          o If start is supplied and end is not supplied, the display\n\
            begins at the start char # and continues until EOF.\n\
          o It is generally convenient to pipe the output of this utility\n\
-           to \"more\" (e.g \"bytes tmp.exe | more\").\n\
+           to \"more\" (e.g \"bytes tmp.exe | more\"), or to use -i.\n\
+         o A filename of - reads stdin (e.g \"zcat img.gz | bytes -c -\").\n\
+           Start and end are then reached by skipping, not seeking.\n\
          \n\
          -x prints ASCII values in hexadecimal (default is decimal)\n\
-         -U assumes text file written in Unicode (2 octets per char)\n\
+         -U assumes text file written in Unicode (2 octets per char):\n\
+             shows each UTF-16 code unit's value under the character it\n\
+             decodes to, little or big endian by the byte order mark.\n\
+             -U16le and -U16be force the byte order; -U8 shows UTF-8.\n\
+             Invalid sequences show as U+FFFD and are counted.\n\
          -e report the endianness of current machine then exit\n\
          -c compute and print the 32 bit CRC of the contents of the specified file\n\
+         -m compute the CRC of every file given, walking directories\n\
+             recursively, and print a \"crc  path\" line for each one\n\
+             (e.g. \"bytes -m -j0 dir1 dir2 file3\")\n\
+         -M[SIZE] write a manifest of the CRC of each SIZE byte block\n\
+             (default 1M; K, M and G suffixes) of every file given,\n\
+             walking directories, to a \"file.crcs\" beside it\n\
+         -V verify every file given against its manifest: files whose\n\
+             size and modification time match are skipped, the others\n\
+             are read and the ranges of blocks that changed, and any\n\
+             bytes appended since, are printed\n\
+         -u[SIZE] cut every file given (walking directories) into chunks\n\
+             of about SIZE bytes (default 16K) at boundaries chosen by\n\
+             their content, and report duplicate chunks and how many bytes\n\
+             deduplication would save; -l sets how many are listed\n\
+         -jN compute the CRC, search, scan, compare, profile, manifests or\n\
+             chunks with N threads (0 = one per CPU), and format long\n\
+             dumps with N threads while another reads ahead\n\
+         -aNAME compute the CRC NAME instead of CRC-32: crc16\n\
+             (CRC-16/CCITT-FALSE), crc32, crc32c, crc64 (CRC-64/ECMA-182)\n\
+             or crc64xz. Works with -c, -m and -j.\n\
+         -C same as -acrc16\n\
+         -kNAME force the CRC-32 kernel (byte, slice8, slice16, clmul,\n\
+             armv8); by default the fastest one this CPU supports is used.\n\
+         -f follow the file as it grows (\"bytes -f log.bin [start] [end]\"):\n\
+             print about a page of its end (or from start), then every row\n\
+             appended to it until Ctrl-C or end, and the CRC of all of it.\n\
+             With -c the CRC so far is printed after each new run of bytes.\n\
+         -rLIST dump each range of LIST in turn, e.g. -r100-200,4096+512,8192\n\
+             (START-END, START+LEN, or START for about a page)\n\
+         -RFILE dump each range listed in FILE the same way, one or more\n\
+             per line (# starts a comment)\n\
+         -i page through the file interactively: arrows, PgUp/PgDn, Home/End,\n\
+             ':' go to a char #, '/' find text, '\\' find hex, 'n' next\n\
+             match, 'q' quit. Only the rows on screen are ever read.\n\
          -wXX Set width of output (number of chars across screen = XX)\n\
+         -H show whole rows in holes of sparse files as one line\n\
+         -sHEX search for a byte pattern given in hex (e.g. -sDEADBEEF)\n\
+             and print the offset of every match in [start, end)\n\
+         -STEXT search for the text TEXT the same way (e.g. -S\"PK\")\n\
+         -d with -s or -S, also dump the rows around each match\n\
+         -D compare two files (\"bytes -D a.bin b.bin [start] [end]\") and\n\
+             print each range where they differ, rows of both side by\n\
+             side (-w bytes per pair, at most -l rows per range)\n\
+         -p[SIZE] print the entropy of each SIZE byte block (default 1M;\n\
+             K, M and G suffixes), then the count of every byte value\n\
+             and the entropy of the whole range\n\
+         -g[FILE] scan for the magic bytes of embedded files (ZIP, PNG,\n\
+             ELF, gzip, PDF, JPEG, ...) in one pass and print the offset\n\
+             and format of each. FILE adds signatures, one \"name hex\n\
+             [offset]\" per line.\n\
+         --stats on exit, report bytes processed, time spent reading,\n\
+             computing, formatting and writing, read calls and MB/s\n\
          -lX Set num lines of output to print, when no 'end' value is\n\
              specified. X must be an integer.\n\
          \n\
@@ -199,6 +510,25 @@ void shift(char *str)
       str[i] = str[i + 1];
 }
 
+/***************************************************************************
+   Convert a size such as "4096", "64K", "16M" or "2G" to bytes. Returns 0
+   if str is empty or not a number.
+***************************************************************************/
+
+long long ParseSize(const char* str)
+{
+    char* suffix;
+    long long size = strtoll(str, &suffix, 0);
+
+    switch (toupper((unsigned char)*suffix))
+    {
+        case 'K':   size *= 1024;                   break;
+        case 'M':   size *= 1024 * 1024;            break;
+        case 'G':   size *= 1024LL * 1024 * 1024;   break;
+    }
+    return suffix == str ? 0 : size;
+}
+
 /***************************************************************************
    This function checks all args to see if they begin with a hyphen.
    If so the necessary flags are set.  argc and argv[] are adjusted
@@ -217,8 +547,23 @@ int deal_with_options(int arrgc, char *arrgv[])
         if(*arrgv[j] == '|')
             arrgc = j; // Set num args for this app to current loop counter value
 
-        // Only process as a switch or option if begins with '-'
-        if(*arrgv[j] == '-')
+        // Long options are whole words
+        if(strcmp(arrgv[j], "--stats") == 0)
+        {
+            if (!g_printStats)
+                atexit(PrintStats);
+            g_printStats = true;
+
+            for(i = j; i < arrgc - 1; i++)
+                arrgv[i] = arrgv[i + 1];
+            arrgc--;
+            j--;
+            continue;
+        }
+
+        // Only process as a switch or option if begins with '-'. A lone
+        // '-' is the file name for stdin.
+        if(*arrgv[j] == '-' && *(arrgv[j] + 1) != 0)
         {
             if(*(arrgv[j] + 1) == '/')
             {
@@ -235,10 +580,24 @@ int deal_with_options(int arrgc, char *arrgv[])
                     switch(*(arrgv[j] + i))
                     {
                         case 'x':
-                            g_numberFormat = BYTES_HEX_FORMAT;
+                            g_config.numberFormat = BYTES_HEX_FORMAT;
                             break;
                         case 'U':
+                            // May be succeeded with the encoding: 8, 16, 16le
+                            // or 16be. Plain -U is UTF-16 in the byte order
+                            // given by the BOM.
                             g_textEncoding = BYTES_UNICODE;
+                            if (strcmp(arrgv[j] + i + 1, "8") == 0)
+                                g_textEncoding = BYTES_UTF8;
+                            else if (strcmp(arrgv[j] + i + 1, "16le") == 0)
+                                g_textEncoding = BYTES_UTF16LE;
+                            else if (strcmp(arrgv[j] + i + 1, "16be") == 0)
+                                g_textEncoding = BYTES_UTF16BE;
+                            else if (strcmp(arrgv[j] + i + 1, "16") != 0)
+                                break;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
                             break;
                         case 'e':
                             g_reportEndianness = true;
@@ -246,19 +605,142 @@ int deal_with_options(int arrgc, char *arrgv[])
                             // Set return var to signan caller to exit app
                             break;
                         case 'c':
-                            g_compute32BitCRC = true;
+                            g_computeCRC = true;
+                            break;
+                        case 'm':
+                            g_computeCRC = true;
+                            g_batchCRC = true;
+                            break;
+                        case 'H':
+                            g_collapseHoles = true;
+                            break;
+                        case 'd':
+                            g_searchDump = true;
+                            break;
+                        case 'D':
+                            g_compareFiles = true;
+                            break;
+                        case 'p':
+                            // May be succeeded with the block size, in bytes
+                            // or with a K, M or G suffix.
+                            g_profileBlockSz = ParseSize(arrgv[j] + i + 1);
+
+                            // Error check
+                            if (g_profileBlockSz < 1 || g_profileBlockSz > BYTES_MAX_PROFILE_BLOCK_SZ)
+                                g_profileBlockSz = BYTES_DEF_PROFILE_BLOCK_SZ;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'M':
+                            // May be succeeded with the block size, in bytes
+                            // or with a K, M or G suffix.
+                            g_manifestBlockSz = ParseSize(arrgv[j] + i + 1);
+
+                            // Error check
+                            if (g_manifestBlockSz < 1 || g_manifestBlockSz > BYTES_MAX_MANIFEST_BLOCK_SZ)
+                                g_manifestBlockSz = BYTES_DEF_MANIFEST_BLOCK_SZ;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'V':
+                            g_verifyManifests = true;
+                            break;
+                        case 'f':
+                            g_followFile = true;
+                            break;
+                        case 'i':
+                            g_interactive = true;
+                            break;
+                        case 'u':
+                            // May be succeeded with the average chunk size,
+                            // in bytes or with a K, M or G suffix.
+                            g_chunkAvgSz = ParseSize(arrgv[j] + i + 1);
+
+                            // Error check
+                            if (g_chunkAvgSz < BYTES_MIN_CHUNK_SZ || g_chunkAvgSz > BYTES_MAX_CHUNK_SZ)
+                                g_chunkAvgSz = BYTES_DEF_CHUNK_SZ;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'r':
+                            // This option must be succeeded with the ranges.
+                            g_rangeList = arrgv[j] + i + 1;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'R':
+                            // This option must be succeeded with the name of
+                            // a file of ranges.
+                            g_rangeFile = arrgv[j] + i + 1;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'g':
+                            // May be succeeded with the name of a file of
+                            // extra signatures.
+                            g_scanSignatures = true;
+                            g_signatureFile = *(arrgv[j] + i + 1) != 0 ? arrgv[j] + i + 1 : NULL;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 's':
+                        case 'S':
+                            // This option must be succeeded with the pattern,
+                            // hex digits for -s and plain text for -S.
+                            g_searchArgIsHex = *(arrgv[j] + i) == 's';
+                            g_searchArg = arrgv[j] + i + 1;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'k':
+                            // This option must be succeeded with a kernel name.
+                            g_crcKernelName = arrgv[j] + i + 1;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'j':
+                            // This option must be succeeded with an integer and
+                            // then a space. Convert string integer to numeric value.
+                            g_numThreads = atoi(arrgv[j] + i + 1);
+
+                            // Error check, 0 or less means one per CPU
+                            if (g_numThreads < 1)
+                                g_numThreads = (int)std::thread::hardware_concurrency();
+                            if (g_numThreads < 1)
+                                g_numThreads = 1;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
+                            break;
+                        case 'C':
+                            // Short for -acrc16
+                            g_computeCRC = true;
+                            g_crcAlgorithmName = "crc16";
+                            break;
+                        case 'a':
+                            // This option must be succeeded with a CRC name.
+                            g_computeCRC = true;
+                            g_crcAlgorithmName = arrgv[j] + i + 1;
+
+                            // Now move loop counter to end of this option
+                            i = num_opts;
                             break;
-                        //case 'C':
-                        //    g_compute16BitCRC = true;
-                        //    break;
                         case 'w':
                             // This option must be succeeded with an integer and
                             // then a space. Convert string integer to numeric value.
-                            g_numColWidth = atol(arrgv[j] + i + 1);
+                            g_config.numColWidth = atol(arrgv[j] + i + 1);
 
                             // Error check
-                            if (g_numColWidth < 1)
-                                g_numColWidth = BYTES_DEF_NUM_COLS;
+                            if (g_config.numColWidth < 1)
+                                g_config.numColWidth = BYTES_DEF_NUM_COLS;
 
                             // Now move loop counter to end of this option
                             i = num_opts;
@@ -293,212 +775,4639 @@ int deal_with_options(int arrgc, char *arrgv[])
     return arrgc;
 }
 
-// Used only by Make32BitCRCTable().
-unsigned long Reflect(unsigned long ref, char ch)
+/***************************************************************************
+   Choose the CRC-32 kernel (-k) and the CRC (-a). With no name the
+   fastest kernel this CPU supports, and CRC-32, are used. A named kernel
+   that does not exist or cannot run on this CPU, or an unknown CRC, is an
+   error.
+***************************************************************************/
+
+void SelectCRC32Kernel(const char* name)
 {
-    unsigned long value(0);
+    const CRC32KernelInfo* kernel = FindCRC32Kernel(name);
+    int k;
 
-    // Swap bit 0 for bit 7
-    // bit 1 for bit 6, etc.
-    for(int i = 1; i < (ch + 1); i++)
+    if (kernel == NULL)
     {
-        if(ref & 1)
-            value |= 1 << (ch - i);
-        ref >>= 1;
+        fprintf(stderr, "\n  Unknown CRC kernel '%s'. Available kernels:", name);
+        for (k = 0; k < g_numCrc32Kernels; k++)
+            fprintf(stderr, " %s", g_crc32Kernels[k].name);
+        fprintf(stderr, "\n");
+        throw Exception();
     }
-    return value;
-} 
+    if (kernel->available != NULL && !*kernel->available)
+    {
+        fprintf(stderr, "\n  CRC kernel '%s' is not supported by this CPU.\n", name);
+        throw Exception();
+    }
+    g_crc32Kernel = kernel->func;
+}
 
-// Call this function only once to initialize the CRC table.
-void Make32BitCRCTable()
+static const CRCAlgorithm* g_crcAlgorithm = &g_crcAlgorithms[1];
+
+void SelectCRCAlgorithm(const char* name)
 {
-    // This is the official polynomial used by CRC-32
-    // in PKZip, WinZip and Ethernet.
-    unsigned long ulPolynomial = 0x04c11db7;
+    int a;
+
+    if (name == NULL)
+        return;
 
-    // 256 values representing ASCII character codes.
-    for(int i = 0; i <= 0xFF; i++)
+    if (FindCRCAlgorithm(name) != NULL)
     {
-        g_crc32Table[i] = Reflect(i, 8) << 24;
-        for (int j = 0; j < 8; j++)
-                g_crc32Table[i] = (g_crc32Table[i] << 1) ^ (g_crc32Table[i] & (1 << 31) ? ulPolynomial : 0);
-        g_crc32Table[i] = Reflect(g_crc32Table[i], 32);
+        g_crcAlgorithm = FindCRCAlgorithm(name);
+        return;
     }
 
-    g_is32BitCRCTableComputed = true;
+    fprintf(stderr, "\n  Unknown CRC '%s'. Available CRCs:", name);
+    for (a = 0; a < g_numCrcAlgorithms; a++)
+        fprintf(stderr, " %s", g_crcAlgorithms[a].name);
+    fprintf(stderr, "\n");
+    throw Exception();
 }
 
-//***************************************************************************/
-// Once the lookup table has been filled in by the two functions above,
-// this function creates all CRCs using only the lookup table.
-// Be sure to use unsigned variables,
-// because negative values introduce high bits
-// where zero bits are required.
-//***************************************************************************/
+/***************************************************************************
+   Read len bytes at offset pos of an open file without moving the shared
+   file position, so several threads can read the same descriptor. Returns
+   the number of bytes read or -1 on error.
+***************************************************************************/
 
-unsigned long Compute32BitCRC( char* filePath, long long fileSz)
+long long PositionalRead(int fd, void* buff, size_t len, long long pos)
 {
-    // Start out with all bits set high.
-    unsigned long ulCRC = 0xffffffff;
-    unsigned long maxBlockSz = 20000000;
-    unsigned long bytesToRead, crcVal = 0;
-    std::streamsize bytesRead;
-    long long bytesRemaining;
-    //int flDescIn = 0;
-    errno = 0;
-    unsigned char* ptr;
-    unsigned char* buff;
-    ifstream inFile;
+#ifdef _WIN32
+    HANDLE hFile = (HANDLE)_get_osfhandle(fd);
+    OVERLAPPED ov;
+    DWORD bytesRead = 0;
 
-    try
-    {
-        if (!g_is32BitCRCTableComputed)
-            Make32BitCRCTable();
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)(pos & 0xffffffff);
+    ov.OffsetHigh = (DWORD)(pos >> 32);
+    if (!ReadFile(hFile, buff, (DWORD)len, &bytesRead, &ov))
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    return bytesRead;
+#else
+    ssize_t ret;
 
-        printf("\n  File size: %lld\n", fileSz);
+    do
+        ret = pread(fd, buff, len, (off_t)pos);
+    while (ret < 0 && errno == EINTR);
+    return ret;
+#endif
+}
 
-        // Allocate memory for the temp buffer
-        ptr = new unsigned char[fileSz < (long long)maxBlockSz ? fileSz : maxBlockSz];
-        buff = ptr;
+/***************************************************************************
+   Sequential reader shared by the dump and the CRC. Regular files are
+   memory mapped a window at a time and handed out in place, so no bytes
+   are copied; inputs that cannot be mapped are read through one reusable
+   buffer instead. Next() returns a pointer to the requested number of
+   contiguous bytes (fewer only at the end of the input), valid until the
+   next call.
 
-        inFile.open(filePath, ios::in | ios::binary);
-        if (!inFile.good())
-        {
-            HandleFileIOErr(filePath);
-            throw Exception();
-        }
+   The path "-" reads stdin. Streams (stdin, pipes, devices) have no size
+   (Size() is -1) and can only be read forward: Seek() skips ahead by
+   reading and discarding.
 
-        printf("  ");
-        bytesRemaining = fileSz;
-        while (bytesRemaining > 0)
-        {
-            // Get block size or num left, read from infile, write to outfile
-            bytesToRead = (unsigned long) (bytesRemaining < maxBlockSz ? bytesRemaining : maxBlockSz);
-            inFile.read(reinterpret_cast<char*>(buff), bytesToRead);
-            bytesRead = inFile.gcount();
-            bytesRemaining  -= bytesRead;
-            //printf("    Copied %ld bytes to memory buffer, bytes remaining in this file: %lld\n", bytesRead, bytesRemaining);
-            printf(".");
+   The read buffer is kept when the source is closed, so one ByteSource can
+   be reopened on file after file without allocating again.
 
-            // Perform the CRC algorithm on each character in the string, using the lookup table values.
-            for (unsigned long i = 0; i < bytesRead; ++i) {
-                ulCRC = (ulCRC >> 8) ^ g_crc32Table[(ulCRC & 0xFF) ^ buff[i]];
-            }
-        }
+   NextData() finds the data extents of sparse files, so callers can step
+   over holes instead of reading their zeros.
+***************************************************************************/
 
-        // Exclusive OR the result with the beginning value.
-        crcVal = ulCRC ^ 0xffffffff;
-    }
-    catch (Exception)
-    {
-        crcVal = 0;
-    }
+class ByteSource
+{
+public:
+    ByteSource();
+    ~ByteSource();
 
-    inFile.close();
+    bool Open(const char* filePath);
+    void Close();
+    bool Seek(long long pos);
+    size_t Next(const unsigned char** data, size_t len);
+    long long NextData(long long pos, long long* dataEnd);
 
-    return crcVal;
-} 
+    long long Size() const      { return m_size; }
+    long long Position() const  { return m_pos; }
+    bool IsMapped() const       { return m_mappable; }
+    bool IsStream() const       { return m_stream; }
+    bool Failed() const         { return m_failed; }
 
+private:
+    bool MapWindow(long long pos);
+    void UnmapWindow();
+    size_t FillBuffer(size_t len);
 
-/***************************************************************************
-Get the width, in characters, of the console window in which this program
-is running.
-***************************************************************************/
-int GetConsoleWidth()
-{
-#ifdef _WIN32
+    int             m_fd;
+    long long       m_size;
+    long long       m_pos;
+    bool            m_mappable;
+    bool            m_stream;
+    bool            m_failed;
 
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    int columns, rows, retCols;
+    // Mapped window [m_viewPos, m_viewPos + m_viewLen)
+    unsigned char*  m_view;
+    long long       m_viewPos;
+    size_t          m_viewLen;
+#ifdef _WIN32
+    HANDLE          m_hMap;
+#endif
 
-    GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
-    columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-    rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    // Buffered input [m_buffPos, m_buffPos + m_buffLen)
+    unsigned char*  m_buff;
+    long long       m_buffPos;
+    size_t          m_buffLen;
+};
 
-    retCols = (columns - 1) / 4;
-    return ((retCols) < 5 ? 40 : retCols);
-#else
-    return 20;
+ByteSource::ByteSource()
+{
+    m_fd = -1;
+    m_size = m_pos = 0;
+    m_mappable = m_stream = m_failed = false;
+    m_view = NULL;
+    m_viewPos = 0;
+    m_viewLen = 0;
+#ifdef _WIN32
+    m_hMap = NULL;
 #endif
+    m_buff = NULL;
+    m_buffPos = 0;
+    m_buffLen = 0;
 }
 
-/***************************************************************************
-   MAIN
-***************************************************************************/
+ByteSource::~ByteSource()
+{
+    Close();
+    delete[] m_buff;
+}
 
-int main(int argc, char *argv[])
+bool ByteSource::Open(const char* filePath)
 {
-    unsigned char uchr;
-    char* buff;
-    int j, retVal = 0;
-    long long start, end, fileSz, fl_pos, chunkSz, linesPrinted;
-    unsigned int crc, tmp, defNumToShow;
-    int fileRet = 0;
     struct _stat64 statBuff;
-    errno = 0;
-    ifstream inFile;
 
-    try
+    Close();
+
+    if (strcmp(filePath, "-") == 0)
     {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        m_fd = _fileno(stdin);
+        m_size = -1;
+        m_stream = true;
+        return true;
+    }
 
-        g_numColWidth = GetConsoleWidth();
-        g_endianness = DetectEndianness();
+    m_fd = _open(filePath, _O_RDONLY | _O_BINARY);
+    if (m_fd < 0)
+        return false;
 
-        argc = deal_with_options(argc, argv);
+    if (_fstat64(m_fd, &statBuff) != 0)
+    {
+        Close();
+        return false;
+    }
 
-        if(argc != 2 && argc != 3 && argc != 4)
-        {
-            if (!g_reportEndianness && !g_compute32BitCRC && !g_compute16BitCRC)
-                PrintUsage(); // Don't need to print usage in these cases
-            throw Exception();
-        }
+    m_stream = (statBuff.st_mode & S_IFMT) != S_IFREG;
+    m_size = m_stream ? -1 : statBuff.st_size;
+    m_mappable = !m_stream && m_size >= BYTES_MIN_MAP_SZ;
 
-        if (_stat64(argv[1], &statBuff) != 0)
-        {
-            HandleFileIOErr(argv[1]);
-            throw Exception();
-        }
+#ifdef _WIN32
+    if (m_mappable)
+    {
+        m_hMap = CreateFileMapping((HANDLE)_get_osfhandle(m_fd), NULL, PAGE_READONLY, 0, 0, NULL);
+        m_mappable = m_hMap != NULL;
+    }
+#endif
 
-        fileSz = statBuff.st_size;
+    return true;
+}
 
-        if (g_compute16BitCRC || g_compute32BitCRC)
-        {
-    //        if (g_compute16BitCRC)
-    //            printf("CRC16 = %x\n", (crc = Compute16BitCRC(argv[1])));
+void ByteSource::Close()
+{
+    UnmapWindow();
+#ifdef _WIN32
+    if (m_hMap != NULL)
+        CloseHandle(m_hMap);
+    m_hMap = NULL;
+#endif
+    if (m_fd >= 0 && m_fd != _fileno(stdin))
+        _close(m_fd);
+    m_fd = -1;
 
-            if (g_compute32BitCRC)
-            {
-                crc = Compute32BitCRC(argv[1], fileSz);
-                printf("\n  CRC32 = %x\n", crc);
-            }
-        }
+    m_buffPos = 0;
+    m_buffLen = 0;
+    m_size = m_pos = 0;
+    m_mappable = m_stream = m_failed = false;
+}
 
-        if (g_compute32BitCRC && argc < 3)
-            throw Exception(); // No error, just finished
+bool ByteSource::Seek(long long pos)
+{
+    if (!m_stream)
+    {
+        if (pos < 0 || pos > m_size)
+            return false;
+        m_pos = pos;
+        return true;
+    }
 
-        // By default, if no start and/or end byte numbers are given on the command line,
-        // show about a page of bytes.
-        start = 0;
-        end = (defNumToShow = BYTES_DEF_NUM_COLS * BYTES_DEF_NUM_LINES) < fileSz ? defNumToShow : fileSz;
+    // A stream can go back only as far as what is still buffered, and
+    // goes forward by reading. Returns false if it ends first.
+    if (pos < m_buffPos)
+        return false;
 
-        if(argc >= 3)
-        {
+    while (m_pos < pos)
+    {
+        long long have = m_buffPos + (long long)m_buffLen - m_pos;
+        if (have == 0 && (have = (long long)FillBuffer(BYTES_READ_BUFF_SZ)) == 0)
+            return false;
+        m_pos += pos - m_pos < have ? pos - m_pos : have;
+    }
+    m_pos = pos;
+    return true;
+}
+
+/***************************************************************************
+   Map the window of the file that starts at, or just before, pos. Falls
+   back to buffered reads for the rest of the file if mapping fails (e.g.
+   out of address space).
+***************************************************************************/
+
+bool ByteSource::MapWindow(long long pos)
+{
+    long long base, len;
+    static long long granularity = 0;
+
+    if (granularity == 0)
+    {
+#ifdef _WIN32
+        SYSTEM_INFO sysInfo;
+        GetSystemInfo(&sysInfo);
+        granularity = sysInfo.dwAllocationGranularity;
+#else
+        granularity = sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    UnmapWindow();
+
+    base = pos - pos % granularity;
+    len = m_size - base < BYTES_MAP_WINDOW_SZ ? m_size - base : BYTES_MAP_WINDOW_SZ;
+
+    if (g_printStats)
+        g_stats.mapCalls++;
+
+#ifdef _WIN32
+    m_view = (unsigned char*)MapViewOfFile(m_hMap, FILE_MAP_READ,
+        (DWORD)(base >> 32), (DWORD)(base & 0xffffffff), (SIZE_T)len);
+#else
+    void* view = mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED, m_fd, (off_t)base);
+    m_view = view == MAP_FAILED ? NULL : (unsigned char*)view;
+    if (m_view != NULL)
+    {
+        // The whole window is about to be read front to back
+        madvise(m_view, (size_t)len, MADV_SEQUENTIAL);
+        madvise(m_view, (size_t)len, MADV_WILLNEED);
+    }
+#endif
+
+    if (m_view == NULL)
+    {
+        m_mappable = false;
+        return false;
+    }
+
+    m_viewPos = base;
+    m_viewLen = (size_t)len;
+    return true;
+}
+
+void ByteSource::UnmapWindow()
+{
+    if (m_view == NULL)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_view);
+#else
+    munmap(m_view, m_viewLen);
+#endif
+    m_view = NULL;
+    m_viewLen = 0;
+}
+
+/***************************************************************************
+   Make at least len bytes from m_pos available in the buffer, keeping what
+   is already there and reading as much as fits in as few calls as
+   possible. Returns the number of bytes available from m_pos.
+***************************************************************************/
+
+size_t ByteSource::FillBuffer(size_t len)
+{
+    size_t have;
+    long long bytesRead;
+
+    if (m_buff == NULL)
+        m_buff = new unsigned char[BYTES_READ_BUFF_SZ];
+
+    // Streams are always read in order so the buffer ends where the next
+    // read starts; files are refilled from wherever m_pos now is.
+    if (!m_stream && (m_pos < m_buffPos || m_pos > m_buffPos + (long long)m_buffLen))
+    {
+        m_buffPos = m_pos;
+        m_buffLen = 0;
+    }
+
+    have = (size_t)(m_buffPos + m_buffLen - m_pos);
+    if (have >= len)
+        return have;
+
+    // Move the unread tail to the front, then top up behind it
+    memmove(m_buff, m_buff + (m_pos - m_buffPos), have);
+    m_buffPos = m_pos;
+    m_buffLen = have;
+
+    while (m_buffLen < len)
+    {
+        if (m_stream)
+        {
+            do
+                bytesRead = _read(m_fd, m_buff + m_buffLen, (unsigned int)(BYTES_READ_BUFF_SZ - m_buffLen));
+            while (bytesRead < 0 && errno == EINTR);
+        }
+        else
+            bytesRead = PositionalRead(m_fd, m_buff + m_buffLen, BYTES_READ_BUFF_SZ - m_buffLen, m_buffPos + m_buffLen);
+        if (g_printStats)
+        {
+            g_stats.readCalls++;
+            g_stats.bytesRead += bytesRead > 0 ? bytesRead : 0;
+        }
+        if (bytesRead < 0)
+            m_failed = true;
+        if (bytesRead <= 0)
+            break;
+        m_buffLen += (size_t)bytesRead;
+    }
+
+    return m_buffLen;
+}
+
+/***************************************************************************
+   Return the start of the first data extent at or after pos and set
+   *dataEnd to its end; everything from pos up to the returned offset is a
+   hole that reads as zeros. Returns Size() if only a hole is left. Inputs
+   without hole information are one extent covering the whole input.
+***************************************************************************/
+
+long long ByteSource::NextData(long long pos, long long* dataEnd)
+{
+    *dataEnd = m_stream ? LLONG_MAX : m_size;
+    if (m_stream || pos >= m_size)
+        return pos;
+
+#if defined(_WIN32)
+    FILE_ALLOCATED_RANGE_BUFFER query, range;
+    DWORD bytesReturned = 0;
+
+    query.FileOffset.QuadPart = pos;
+    query.Length.QuadPart = m_size - pos;
+    if (!DeviceIoControl((HANDLE)_get_osfhandle(m_fd), FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+                         &range, sizeof(range), &bytesReturned, NULL) && GetLastError() != ERROR_MORE_DATA)
+        return pos;
+    if (bytesReturned < sizeof(range))
+        return m_size;
+
+    long long start = range.FileOffset.QuadPart > pos ? range.FileOffset.QuadPart : pos;
+    *dataEnd = range.FileOffset.QuadPart + range.Length.QuadPart;
+    if (*dataEnd > m_size)
+        *dataEnd = m_size;
+    return start;
+#elif defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off_t start = lseek(m_fd, (off_t)pos, SEEK_DATA);
+    if (start < 0)
+        return errno == ENXIO ? m_size : pos;   // ENXIO: nothing but hole left
+
+    off_t end = lseek(m_fd, start, SEEK_HOLE);
+    if (end >= start && end < m_size)
+        *dataEnd = end;
+    return start;
+#else
+    return pos;
+#endif
+}
+
+size_t ByteSource::Next(const unsigned char** data, size_t len)
+{
+    PhaseTimer timer(BYTES_PHASE_READ);
+
+    if (len > BYTES_READ_BUFF_SZ)
+        len = BYTES_READ_BUFF_SZ;
+    if (m_size >= 0 && (long long)len > m_size - m_pos)
+        len = (size_t)(m_size - m_pos);
+    if (len == 0 || m_fd < 0)
+        return 0;
+
+    if (m_mappable)
+    {
+        if (m_view == NULL || m_pos < m_viewPos || m_pos + (long long)len > m_viewPos + (long long)m_viewLen)
+            MapWindow(m_pos);
+
+        if (m_view != NULL)
+        {
+            *data = m_view + (m_pos - m_viewPos);
+            m_pos += len;
+            return len;
+        }
+    }
+
+    size_t have = FillBuffer(len);
+    if (len > have)
+        len = have;
+    *data = m_buff + (m_pos - m_buffPos);
+    m_pos += len;
+    return len;
+}
+
+/***************************************************************************
+   Feed bytes [pos, end) of a file into crc. Holes are fed in with
+   BytesCRCZeros() rather than read, so a sparse file costs only as much as
+   its data. Returns false on a read error.
+***************************************************************************/
+
+bool UpdateCRCRange(ByteSource& src, long long pos, long long end, BytesCRC& crc)
+{
+    const unsigned char* data;
+    long long dataStart, dataEnd;
+    size_t bytesRead;
+
+    while (pos < end)
+    {
+        dataStart = src.NextData(pos, &dataEnd);
+        if (dataStart > end)
+            dataStart = end;
+        if (dataEnd > end)
+            dataEnd = end;
+
+        if (dataStart > pos)
+        {
+            PhaseTimer timer(BYTES_PHASE_COMPUTE);
+            BytesCRCZeros(crc, dataStart - pos);
+            CountProcessed(dataStart - pos);
+            pos = dataStart;
+        }
+
+        if (pos < dataEnd && !src.Seek(pos))
+            return false;
+        while (pos < dataEnd)
+        {
+            size_t toRead = (size_t)(dataEnd - pos < BYTES_READ_BUFF_SZ ? dataEnd - pos : BYTES_READ_BUFF_SZ);
+            if ((bytesRead = src.Next(&data, toRead)) == 0)
+                return false;
+            {
+                PhaseTimer timer(BYTES_PHASE_COMPUTE);
+                BytesCRCUpdate(crc, data, bytesRead);
+            }
+            CountProcessed(bytesRead);
+            pos += bytesRead;
+        }
+    }
+
+    return true;
+}
+
+/***************************************************************************
+   Compute the selected CRC of the file with numThreads worker threads. The
+   file is cut into pieces that the workers pick up in turn; each piece's
+   CRC is computed independently and the CRCs are then chained in file
+   order with BytesCRCCombine(), so the result is bit for bit the single
+   threaded CRC.
+***************************************************************************/
+
+uint64_t ComputeCRCParallel(char* filePath, long long fileSz, int numThreads)
+{
+    long long pieceSz, numPieces;
+
+    // Aim for several pieces per thread so a slow piece does not hold up
+    // the others, but keep pieces large enough to read efficiently.
+    pieceSz = fileSz / ((long long)numThreads * 4);
+    if (pieceSz < BYTES_THREAD_BLOCK_SZ)
+        pieceSz = BYTES_THREAD_BLOCK_SZ;
+    if (pieceSz > BYTES_THREAD_PIECE_SZ)
+        pieceSz = BYTES_THREAD_PIECE_SZ;
+    numPieces = (fileSz + pieceSz - 1) / pieceSz;
+    if (numThreads > numPieces)
+        numThreads = (int)numPieces;
+
+    std::vector<uint64_t> pieceCRCs((size_t)numPieces);
+    std::atomic<long long> nextPiece(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < numThreads; t++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            // Each worker has its own view of the file
+            ByteSource src;
+            long long piece;
+
+            if (!src.Open(filePath))
+            {
+                failed = true;
+                return;
+            }
+
+            while (!failed && (piece = nextPiece++) < numPieces)
+            {
+                long long pos = piece * pieceSz;
+                long long end = pos + pieceSz < fileSz ? pos + pieceSz : fileSz;
+                BytesCRC crc;
+
+                BytesCRCStart(crc, g_crcAlgorithm->name);
+                if (!UpdateCRCRange(src, pos, end, crc))
+                    failed = true;
+                pieceCRCs[(size_t)piece] = BytesCRCValue(crc);
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    if (failed)
+    {
+        HandleFileIOErr(filePath);
+        throw Exception();
+    }
+
+    BytesCRC crc;
+    uint64_t crcVal = pieceCRCs[0];
+
+    BytesCRCStart(crc, g_crcAlgorithm->name);
+    for (long long piece = 1; piece < numPieces; piece++)
+    {
+        long long len = piece == numPieces - 1 ? fileSz - piece * pieceSz : pieceSz;
+        crcVal = BytesCRCCombine(crc, crcVal, pieceCRCs[(size_t)piece], len);
+    }
+
+    return crcVal;
+}
+
+//***************************************************************************/
+// Compute the CRC selected with -a (CRC-32 by default) of the whole file,
+// printing a progress dot per 20 MB. Be sure to use unsigned variables,
+// because negative values introduce high bits where zero bits are
+// required.
+//***************************************************************************/
+
+uint64_t ComputeCRC( char* filePath, long long fileSz)
+{
+    BytesCRC crc;
+    uint64_t crcVal = 0;
+    const long long dotBlockSz = 20000000;
+    long long bytesDone = 0, dotsPrinted = 0;
+    const unsigned char* buff;
+    size_t bytesRead;
+    errno = 0;
+    ByteSource src;
+
+    try
+    {
+        // A stream's size is only known once it has been read
+        if (g_printProgress)
+        {
+            if (fileSz >= 0)
+                printf("\n  File size: %lld\n", fileSz);
+            else
+                printf("\n");
+        }
+
+        // Only worth starting threads when there is more than one block
+        if (g_numThreads > 1 && fileSz > BYTES_THREAD_BLOCK_SZ)
+            return ComputeCRCParallel(filePath, fileSz, g_numThreads);
+
+        if (!src.Open(filePath))
+        {
+            HandleFileIOErr(filePath);
+            throw Exception();
+        }
+
+        if (g_printProgress)
+            printf("  ");
+
+        BytesCRCStart(crc, g_crcAlgorithm->name);
+
+        // One progress dot per 20 MB started
+        for (bytesDone = 0; !src.IsStream() && bytesDone < fileSz; bytesDone += dotBlockSz)
+        {
+            long long end = fileSz - bytesDone < dotBlockSz ? fileSz : bytesDone + dotBlockSz;
+            if (!UpdateCRCRange(src, bytesDone, end, crc))
+            {
+                HandleFileIOErr(filePath);
+                throw Exception();
+            }
+            if (g_printProgress)
+                printf(".");
+        }
+
+        // Streams have no holes or size; read them to the end
+        while (src.IsStream() && (bytesRead = src.Next(&buff, BYTES_READ_BUFF_SZ)) > 0)
+        {
+            // Perform the CRC algorithm on the block with the selected kernel.
+            {
+                PhaseTimer timer(BYTES_PHASE_COMPUTE);
+                BytesCRCUpdate(crc, buff, bytesRead);
+            }
+            CountProcessed(bytesRead);
+
+            // One progress dot per 20 MB started
+            for (bytesDone += bytesRead; dotsPrinted * dotBlockSz < bytesDone; dotsPrinted++)
+            {
+                if (g_printProgress)
+                    printf(".");
+            }
+        }
+
+        if (src.Failed())
+        {
+            HandleFileIOErr(filePath);
+            throw Exception();
+        }
+
+        if (fileSz < 0 && g_printProgress)
+            printf("\n  Bytes read: %lld", bytesDone);
+
+        crcVal = BytesCRCValue(crc);
+    }
+    catch (Exception)
+    {
+        crcVal = 0;
+    }
+
+    return crcVal;
+} 
+
+
+/***************************************************************************
+   Batch CRC of many files (-m). Directories are walked recursively in name
+   order, without following symbolic links below the top level.
+***************************************************************************/
+
+struct BatchFile
+{
+    std::string     path;
+    long long       size;
+};
+
+void CollectBatchFiles(const std::filesystem::path& path, bool isTopLevel, std::vector<BatchFile>& files)
+{
+    std::error_code ec;
+    std::filesystem::file_status status;
+
+    status = isTopLevel ? std::filesystem::status(path, ec) : std::filesystem::symlink_status(path, ec);
+    if (ec)
+    {
+        fprintf(stderr, "  %s: %s\n", path.string().c_str(), ec.message().c_str());
+        return;
+    }
+
+    if (std::filesystem::is_directory(status))
+    {
+        std::vector<std::filesystem::path> entries;
+        std::filesystem::directory_iterator it(path, ec), dirEnd;
+
+        for (; !ec && it != dirEnd; it.increment(ec))
+            entries.push_back(it->path());
+        if (ec)
+            fprintf(stderr, "  %s: %s\n", path.string().c_str(), ec.message().c_str());
+
+        std::sort(entries.begin(), entries.end());
+        for (size_t i = 0; i < entries.size(); i++)
+            CollectBatchFiles(entries[i], false, files);
+    }
+    else if (std::filesystem::is_regular_file(status))
+    {
+        BatchFile file;
+        file.path = path.string();
+        file.size = (long long)std::filesystem::file_size(path, ec);
+        files.push_back(file);
+    }
+}
+
+/***************************************************************************
+   Checksum every file named in paths[] (files or directories) with
+   g_numThreads workers and print "crc  path" lines in walk order. Files
+   larger than a piece are split and their piece CRCs combined; runs of
+   small files are scheduled together. Every worker keeps one ByteSource,
+   and so one read buffer, for all the files it handles.
+***************************************************************************/
+
+int ComputeBatchCRCs(char** paths, int numPaths)
+{
+    struct Part  { size_t file; long long start, end; };
+    struct Item  { size_t firstPart, lastPart; };
+
+    std::vector<BatchFile> files;
+    std::vector<Part> parts;
+    std::vector<Item> items;
+    std::vector<size_t> firstPartOfFile;
+    int retVal = 0;
+
+    for (int i = 0; i < numPaths; i++)
+        CollectBatchFiles(paths[i], true, files);
+
+    // Cut the file list into parts, and the parts into work items
+    Item batch = { 0, 0 };
+    long long batchBytes = 0;
+
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        firstPartOfFile.push_back(parts.size());
+
+        if (files[f].size <= BYTES_THREAD_PIECE_SZ)
+        {
+            Part part = { f, 0, files[f].size };
+            parts.push_back(part);
+            batchBytes += files[f].size;
+            if (batchBytes >= BYTES_BATCH_BYTES || parts.size() - batch.firstPart >= BYTES_BATCH_FILES)
+            {
+                batch.lastPart = parts.size();
+                items.push_back(batch);
+                batch.firstPart = parts.size();
+                batchBytes = 0;
+            }
+            continue;
+        }
+
+        for (long long pos = 0; pos < files[f].size; pos += BYTES_THREAD_PIECE_SZ)
+        {
+            Part part = { f, pos, std::min(pos + BYTES_THREAD_PIECE_SZ, files[f].size) };
+            Item piece = { parts.size(), parts.size() + 1 };
+            parts.push_back(part);
+            items.push_back(piece);
+        }
+    }
+    firstPartOfFile.push_back(parts.size());
+
+    // Whatever small files are left, and the run that a large file cut short
+    batch.lastPart = parts.size();
+    if (batch.lastPart > batch.firstPart)
+        items.push_back(batch);
+
+    std::vector<uint64_t> partCRCs(parts.size());
+    std::vector<char> fileFailed(files.size(), 0);
+    std::atomic<size_t> nextItem(0);
+    std::vector<std::thread> workers;
+    int numThreads = (int)std::min((size_t)g_numThreads, items.size());
+
+    for (int t = 0; t < numThreads; t++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            ByteSource src;
+            size_t item;
+
+            while ((item = nextItem++) < items.size())
+            {
+                for (size_t p = items[item].firstPart; p < items[item].lastPart; p++)
+                {
+                    const Part& part = parts[p];
+                    BytesCRC crc;
+
+                    BytesCRCStart(crc, g_crcAlgorithm->name);
+                    if (!src.Open(files[part.file].path.c_str()) ||
+                        !UpdateCRCRange(src, part.start, part.end, crc))
+                        fileFailed[part.file] = 1;
+                    partCRCs[p] = BytesCRCValue(crc);
+                }
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        if (fileFailed[f])
+        {
+            fprintf(stderr, "  %s: read error\n", files[f].path.c_str());
+            retVal = -1;
+            continue;
+        }
+
+        // Chain the parts' CRCs in file order
+        BytesCRC crc;
+        BytesCRCStart(crc, g_crcAlgorithm->name);
+        uint64_t crcVal = BytesCRCValue(crc);
+        for (size_t p = firstPartOfFile[f]; p < firstPartOfFile[f + 1]; p++)
+            crcVal = BytesCRCCombine(crc, crcVal, partCRCs[p], parts[p].end - parts[p].start);
+        printf("%0*llx  %s\n", g_crcAlgorithm->width / 4, (unsigned long long)crcVal, files[f].path.c_str());
+    }
+
+    return retVal;
+}
+
+/***************************************************************************
+   Collects formatted text and hands it to stdout (or another file) in large
+   writes. Anything printed with printf before is flushed first, so output
+   stays in order.
+***************************************************************************/
+
+class OutputBuffer
+{
+public:
+    OutputBuffer(FILE* file = stdout, size_t size = BYTES_OUT_BUFF_SZ);
+    ~OutputBuffer();
+
+    // Get room for len chars; the caller fills them in and calls Commit().
+    char* Reserve(size_t len);
+    void Commit(size_t len)     { m_len += len; }
+    void Write(const char* str, size_t len);
+    void WriteThrough(const char* str, size_t len);
+    void Flush();
+
+private:
+    FILE*   m_file;
+    char*   m_buff;
+    size_t  m_size;
+    size_t  m_len;
+};
+
+OutputBuffer::OutputBuffer(FILE* file, size_t size)
+{
+    m_file = file;
+    m_buff = new char[size];
+    m_size = size;
+    m_len = 0;
+    fflush(stdout);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    Flush();
+    delete[] m_buff;
+}
+
+char* OutputBuffer::Reserve(size_t len)
+{
+    if (m_len + len > m_size)
+    {
+        Flush();
+        if (len > m_size)
+        {
+            delete[] m_buff;
+            m_buff = new char[m_size = len];
+        }
+    }
+    return m_buff + m_len;
+}
+
+void OutputBuffer::Write(const char* str, size_t len)
+{
+    memcpy(Reserve(len), str, len);
+    Commit(len);
+}
+
+// Write a large block of text straight to the file, after what is
+// buffered, without copying it into the buffer first
+void OutputBuffer::WriteThrough(const char* str, size_t len)
+{
+    Flush();
+
+    PhaseTimer timer(BYTES_PHASE_WRITE);
+    fwrite(str, 1, len, m_file);
+}
+
+void OutputBuffer::Flush()
+{
+    PhaseTimer timer(BYTES_PHASE_WRITE);
+
+    if (m_len > 0)
+        fwrite(m_buff, 1, m_len, m_file);
+    fflush(m_file);
+    m_len = 0;
+}
+
+// Print the rows of len bytes of data, at most maxLines of them, and
+// return how many were printed
+long long DumpRows(const unsigned char* data, size_t len, long long maxLines, OutputBuffer& out)
+{
+    size_t width = (size_t)g_config.numColWidth, off, n, textSz;
+    long long rows = (long long)((len + width - 1) / width);
+    PhaseTimer timer(BYTES_PHASE_FORMAT);
+
+    if (rows > maxLines)
+    {
+        rows = maxLines > 0 ? maxLines : 0;
+        len = (size_t)rows * width;
+    }
+
+    // As many rows at a time as fit in the output buffer
+    size_t batchSz = BYTES_OUT_BUFF_SZ / BytesFormatSize(g_config, width) * width;
+    if (batchSz == 0)
+        batchSz = width;
+    for (off = 0; off < len; off += n)
+    {
+        n = len - off < batchSz ? len - off : batchSz;
+        textSz = BytesFormatSize(g_config, n);
+        out.Commit(BytesFormat(g_config, data + off, n, out.Reserve(textSz), textSz));
+    }
+    return rows;
+}
+
+/***************************************************************************
+   Pipelined dump, for long dumps with -j. A reader thread copies the
+   input into blocks of whole rows, g_numThreads formatter threads each
+   render a whole block into the block's own text, and the calling thread
+   writes the texts strictly in block order. Blocks live in a fixed ring
+   of slots, so memory stays bounded however long the range is, and the
+   rows are cut exactly where the serial loop cuts them, so the output is
+   the same byte for byte.
+***************************************************************************/
+
+struct DumpSlot
+{
+    long long                   seq;        // Block number it holds, -1 if free
+    int                         state;
+    std::vector<unsigned char>  data;
+    size_t                      len;
+    std::vector<char>           text;
+    size_t                      textLen;
+};
+
+#define BYTES_SLOT_FREE         0
+#define BYTES_SLOT_READ         1
+#define BYTES_SLOT_FORMATTING   2
+#define BYTES_SLOT_FORMATTED    3
+
+void DumpRangePipelined(ByteSource& src, long long start, long long end, OutputBuffer& out)
+{
+    size_t width = (size_t)g_config.numColWidth;
+    size_t blockSz = BYTES_PIPE_BLOCK_SZ / width > 0 ? BYTES_PIPE_BLOCK_SZ / width * width : width;
+    int numFormatters = g_numThreads;
+    std::vector<DumpSlot> slots((size_t)(2 * numFormatters + 2));
+    long long numRead = 0;                  // Blocks handed over by the reader
+    bool isReadDone = false, failed = false;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> threads;
+
+    for (size_t s = 0; s < slots.size(); s++)
+    {
+        slots[s].seq = -1;
+        slots[s].state = BYTES_SLOT_FREE;
+        slots[s].data.resize(blockSz);
+        slots[s].text.resize(BytesFormatSize(g_config, blockSz));
+    }
+
+    // Reader: block n goes to slot n % slots, once the writer is done with
+    // block n - slots
+    threads.push_back(std::thread([&]()
+    {
+        const unsigned char* data;
+        long long pos = start;
+        size_t got = 0;
+
+        for (long long seq = 0; pos < end; seq++, pos += (long long)got)
+        {
+            DumpSlot& slot = slots[(size_t)(seq % (long long)slots.size())];
+            size_t want = end - pos < (long long)blockSz ? (size_t)(end - pos) : blockSz;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return slot.state == BYTES_SLOT_FREE || failed; });
+                if (failed)
+                    break;
+            }
+
+            // Next() hands out at most a read buffer at a time
+            for (slot.len = 0; slot.len < want; slot.len += got)
+            {
+                if ((got = src.Next(&data, want - slot.len)) == 0)
+                    break;
+                memcpy(&slot.data[slot.len], data, got);
+            }
+            got = slot.len;
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (got < want && (!src.IsStream() || src.Failed()))
+                failed = true;
+            if (got > 0)
+            {
+                slot.seq = seq;
+                slot.state = BYTES_SLOT_READ;
+                numRead = seq + 1;
+            }
+            changed.notify_all();
+            if (got < want)
+                break;      // A stream ended, or an error
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        isReadDone = true;
+        changed.notify_all();
+    }));
+
+    // Formatters: take the lowest read block
+    std::atomic<long long> nextToFormat(0);
+    for (int t = 0; t < numFormatters; t++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (;;)
+            {
+                long long seq = nextToFormat++;
+                DumpSlot& slot = slots[(size_t)(seq % (long long)slots.size())];
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&]() { return (slot.seq == seq && slot.state == BYTES_SLOT_READ) ||
+                                                       (isReadDone && seq >= numRead); });
+                    if (slot.seq != seq || slot.state != BYTES_SLOT_READ)
+                        return;
+                    slot.state = BYTES_SLOT_FORMATTING;
+                }
+
+                {
+                    PhaseTimer timer(BYTES_PHASE_FORMAT);
+                    slot.textLen = BytesFormat(g_config, &slot.data[0], slot.len, &slot.text[0], slot.text.size());
+                }
+                CountProcessed((long long)slot.len);
+
+                std::lock_guard<std::mutex> guard(lock);
+                slot.state = BYTES_SLOT_FORMATTED;
+                changed.notify_all();
+            }
+        }));
+    }
+
+    // Writer: this thread, in block order
+    for (long long seq = 0; ; seq++)
+    {
+        DumpSlot& slot = slots[(size_t)(seq % (long long)slots.size())];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return (slot.seq == seq && slot.state == BYTES_SLOT_FORMATTED) ||
+                                               (isReadDone && seq >= numRead); });
+            if (slot.seq != seq)
+                break;
+        }
+
+        out.WriteThrough(&slot.text[0], slot.textLen);
+
+        std::lock_guard<std::mutex> guard(lock);
+        slot.seq = -1;
+        slot.state = BYTES_SLOT_FREE;
+        changed.notify_all();
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    if (failed)
+        throw Exception("Error reading file!");
+}
+
+/***************************************************************************
+   Print bytes [start, end) of src, -w bytes per row, stopping early
+   after maxLines rows. Data is fetched many rows at a time and each
+   row is rendered straight into the output buffer. With -H, whole rows
+   that fall in a hole of a sparse file are replaced by one "hole" line.
+   With -j, a range of many blocks that is printed in full goes through
+   the pipelined dump instead.
+***************************************************************************/
+
+void DumpTextRange(ByteSource& src, long long start, long long end, long long maxLines, OutputBuffer& out);
+
+void DumpRange(ByteSource& src, long long start, long long end, long long maxLines, OutputBuffer& out)
+{
+    const unsigned char* data;
+    size_t width = (size_t)g_config.numColWidth;
+    size_t rowsPerFetch, got;
+    long long pos, linesPrinted = 0;
+
+    if (g_textEncoding != BYTES_EIGHT_BIT_ASCII)
+    {
+        DumpTextRange(src, start, end, maxLines, out);
+        return;
+    }
+
+    rowsPerFetch = BYTES_READ_BUFF_SZ / width;
+    if (rowsPerFetch < 1)
+        rowsPerFetch = 1;
+
+    if (!src.Seek(start))
+        return;
+
+    if (g_numThreads > 1 && !g_collapseHoles && (end - start - 1) / (long long)width < maxLines &&
+        end - start > 2 * BYTES_PIPE_BLOCK_SZ)
+    {
+        DumpRangePipelined(src, start, end, out);
+        return;
+    }
+
+    for (pos = start; pos < end && linesPrinted < maxLines; pos += got)
+    {
+        long long want = (long long)(rowsPerFetch * width);
+        if (want > end - pos)
+            want = end - pos;
+        if (maxLines - linesPrinted < (want + (long long)width - 1) / (long long)width)
+            want = (maxLines - linesPrinted) * (long long)width;
+
+        if (g_collapseHoles && !src.IsStream())
+        {
+            long long dataEnd, dataStart = src.NextData(pos, &dataEnd);
+            long long holeRows = ((dataStart < end ? dataStart : end) - pos) / (long long)width;
+
+            if (holeRows > 0)
+            {
+                char line[64];
+                int len = snprintf(line, sizeof(line), "    hole: %lld bytes\n\n", holeRows * (long long)width);
+                out.Write(line, len);
+                CountProcessed(holeRows * (long long)width);
+                linesPrinted++;
+                got = (size_t)(holeRows * (long long)width);
+                src.Seek(pos + (long long)got);
+                continue;
+            }
+
+            // Stop at the row holding the end of this extent, so the hole
+            // after it is looked for again
+            long long extentRows = (dataEnd - pos + (long long)width - 1) / (long long)width;
+            if (want > extentRows * (long long)width)
+                want = extentRows * (long long)width;
+        }
+
+        // A stream may simply end early; for a file it is an error
+        if ((got = src.Next(&data, (size_t)want)) != (size_t)want)
+        {
+            if (!src.IsStream() || src.Failed())
+                throw Exception("Error reading file!");
+            end = pos + got;
+        }
+
+        linesPrinted += DumpRows(data, got, maxLines - linesPrinted, out);
+        CountProcessed(got);
+    }
+}
+
+/***************************************************************************
+   Pattern search (-s and -S). Every window of the input is scanned by a
+   kernel that finds all the places where the first and last byte of the
+   pattern both match, sixteen or thirty-two at a time, and checks only
+   those in full. Patterns of BYTES_HORSPOOL_MIN_LEN bytes or more skip
+   ahead with Horspool's bad character rule instead.
+***************************************************************************/
+
+typedef void (*SearchKernel)(const unsigned char* data, size_t len, size_t limit, const unsigned char* pat,
+                             size_t n, long long base, std::vector<long long>& hits);
+
+static inline int CountTrailingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, x);
+    return (int)bit;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/* The kernels report base + i for every i < limit, with i + n <= len,
+   where data[i, i + n) equals the n byte pattern pat. */
+
+static inline size_t NumSearchStarts(size_t len, size_t limit, size_t n)
+{
+    size_t starts = len >= n ? len - n + 1 : 0;
+    return starts < limit ? starts : limit;
+}
+
+static inline void FindPatternFrom(size_t i, const unsigned char* data, size_t starts, const unsigned char* pat,
+                                   size_t n, long long base, std::vector<long long>& hits)
+{
+    const unsigned char* p;
+
+    for (; i < starts; i = (p - data) + 1)
+    {
+        if ((p = (const unsigned char*)memchr(data + i, pat[0], starts - i)) == NULL)
+            break;
+        if (memcmp(p, pat, n) == 0)
+            hits.push_back(base + (p - data));
+    }
+}
+
+void FindPatternScalar(const unsigned char* data, size_t len, size_t limit, const unsigned char* pat,
+                       size_t n, long long base, std::vector<long long>& hits)
+{
+    FindPatternFrom(0, data, NumSearchStarts(len, limit, n), pat, n, base, hits);
+}
+
+void FindPatternHorspool(const unsigned char* data, size_t len, size_t limit, const unsigned char* pat,
+                         size_t n, long long base, std::vector<long long>& hits)
+{
+    size_t skip[256], starts = NumSearchStarts(len, limit, n), i;
+    unsigned char lastByte = pat[n - 1], c;
+
+    for (i = 0; i < 256; i++)
+        skip[i] = n;
+    for (i = 0; i < n - 1; i++)
+        skip[pat[i]] = n - 1 - i;
+
+    for (i = 0; i < starts; i += skip[c])
+    {
+        c = data[i + n - 1];
+        if (c == lastByte && memcmp(data + i, pat, n - 1) == 0)
+            hits.push_back(base + i);
+    }
+}
+
+#if defined(BYTES_X86)
+
+BYTES_TARGET("sse2")
+void FindPatternSSE2(const unsigned char* data, size_t len, size_t limit, const unsigned char* pat,
+                     size_t n, long long base, std::vector<long long>& hits)
+{
+    const __m128i first = _mm_set1_epi8((char)pat[0]), last = _mm_set1_epi8((char)pat[n - 1]);
+    size_t starts = NumSearchStarts(len, limit, n), i;
+
+    for (i = 0; i + 16 <= starts; i += 16)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + n - 1)), last);
+        uint64_t mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+
+        for (; mask != 0; mask &= mask - 1)
+        {
+            size_t at = i + CountTrailingZeros(mask);
+            if (memcmp(data + at, pat, n) == 0)
+                hits.push_back(base + at);
+        }
+    }
+    FindPatternFrom(i, data, starts, pat, n, base, hits);
+}
+
+BYTES_TARGET("avx2")
+void FindPatternAVX2(const unsigned char* data, size_t len, size_t limit, const unsigned char* pat,
+                     size_t n, long long base, std::vector<long long>& hits)
+{
+    const __m256i first = _mm256_set1_epi8((char)pat[0]), last = _mm256_set1_epi8((char)pat[n - 1]);
+    size_t starts = NumSearchStarts(len, limit, n), i;
+
+    for (i = 0; i + 32 <= starts; i += 32)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), first);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + n - 1)), last);
+        uint64_t mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+
+        for (; mask != 0; mask &= mask - 1)
+        {
+            size_t at = i + CountTrailingZeros(mask);
+            if (memcmp(data + at, pat, n) == 0)
+                hits.push_back(base + at);
+        }
+    }
+    FindPatternFrom(i, data, starts, pat, n, base, hits);
+}
+
+#endif // BYTES_X86
+
+#if defined(BYTES_ARM64)
+
+// NEON has no movemask; narrowing the compare result leaves 4 bits per byte
+void FindPatternNEON(const unsigned char* data, size_t len, size_t limit, const unsigned char* pat,
+                     size_t n, long long base, std::vector<long long>& hits)
+{
+    const uint8x16_t first = vdupq_n_u8(pat[0]), last = vdupq_n_u8(pat[n - 1]);
+    size_t starts = NumSearchStarts(len, limit, n), i;
+
+    for (i = 0; i + 16 <= starts; i += 16)
+    {
+        uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(data + i), first), vceqq_u8(vld1q_u8(data + i + n - 1), last));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        for (; mask != 0; mask &= ~(0xFULL << (CountTrailingZeros(mask) & ~3)))
+        {
+            size_t at = i + (CountTrailingZeros(mask) >> 2);
+            if (memcmp(data + at, pat, n) == 0)
+                hits.push_back(base + at);
+        }
+    }
+    FindPatternFrom(i, data, starts, pat, n, base, hits);
+}
+
+#endif // BYTES_ARM64
+
+struct SearchKernelInfo
+{
+    const char*     name;
+    SearchKernel    func;
+    const bool*     available;  // NULL if always available
+};
+
+static const SearchKernelInfo g_searchKernels[] =
+{
+    { "scalar", FindPatternScalar,  NULL },
+#if defined(BYTES_X86)
+    { "sse2",   FindPatternSSE2,    NULL },
+    { "avx2",   FindPatternAVX2,    &g_cpuHasAvx2 },
+#endif
+#if defined(BYTES_ARM64)
+    { "neon",   FindPatternNEON,    NULL },
+#endif
+};
+
+static const int g_numSearchKernels = sizeof(g_searchKernels) / sizeof(g_searchKernels[0]);
+
+SearchKernel SelectSearchKernel(size_t n)
+{
+    int k;
+
+    if (n >= BYTES_HORSPOOL_MIN_LEN)
+        return FindPatternHorspool;
+
+    for (k = g_numSearchKernels - 1; k > 0; k--)
+    {
+        if (g_searchKernels[k].available == NULL || *g_searchKernels[k].available)
+            break;
+    }
+    return g_searchKernels[k].func;
+}
+
+/***************************************************************************
+   Turn the -s argument, pairs of hex digits optionally separated by
+   spaces, ':' or '-', into the pattern bytes. Returns false if it is not
+   valid hex.
+***************************************************************************/
+
+bool ParseHexPattern(const char* str, std::vector<unsigned char>& pattern)
+{
+    int digits = 0, val = 0;
+
+    pattern.clear();
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+        str += 2;
+
+    for (; *str != 0; str++)
+    {
+        if (*str == ' ' || *str == ':' || *str == '-')
+        {
+            if (digits % 2 != 0)
+                return false;
+            continue;
+        }
+        if (!isxdigit((unsigned char)*str))
+            return false;
+
+        val = val * 16 + (isdigit((unsigned char)*str) ? *str - '0' : toupper((unsigned char)*str) - 'A' + 10);
+        if (++digits % 2 == 0)
+        {
+            pattern.push_back((unsigned char)val);
+            val = 0;
+        }
+    }
+
+    return digits > 0 && digits % 2 == 0;
+}
+
+/***************************************************************************
+   Find g_searchPattern in bytes [pos, end) of src, adding the offsets of
+   matches that start before reportEnd to hits. The input is read in
+   windows that overlap by one byte less than the pattern, so matches that
+   straddle two windows are still seen, once. Returns the offset scanning
+   stopped at (less than end when a stream ends first), or -1 on a read
+   error.
+***************************************************************************/
+
+long long SearchRange(ByteSource& src, long long pos, long long end, long long reportEnd, std::vector<long long>& hits)
+{
+    const unsigned char* pat = &g_searchPattern[0];
+    const unsigned char* data;
+    size_t n = g_searchPattern.size();
+    size_t step = BYTES_READ_BUFF_SZ - (n - 1), got, limit;
+    SearchKernel find = SelectSearchKernel(n);
+
+    while (pos < end && pos < reportEnd)
+    {
+        long long want = end - pos < BYTES_READ_BUFF_SZ ? end - pos : BYTES_READ_BUFF_SZ;
+
+        if (!src.Seek(pos))
+            return src.Failed() ? -1 : pos;
+        if ((got = src.Next(&data, (size_t)want)) < (size_t)want && (!src.IsStream() || src.Failed()))
+            return -1;
+
+        // Matches starting in the overlap are left to the next window,
+        // unless there is none
+        bool isLast = got < (size_t)want || pos + (long long)got >= end;
+        limit = isLast ? got : step;
+        if ((long long)limit > reportEnd - pos)
+            limit = (size_t)(reportEnd - pos);
+
+        {
+            PhaseTimer timer(BYTES_PHASE_COMPUTE);
+            find(data, got, limit, pat, n, pos, hits);
+        }
+        CountProcessed(limit);
+
+        if (isLast)
+            return pos + (long long)got;
+        pos += (long long)step;
+    }
+
+    return pos;
+}
+
+/***************************************************************************
+   Print the matches in hits: one line each, followed with -d by the rows
+   around it (one row before, the match, one row after) from dumpSrc.
+***************************************************************************/
+
+void PrintSearchHits(const std::vector<long long>& hits, ByteSource* dumpSrc, OutputBuffer& out)
+{
+    long long n = (long long)g_searchPattern.size();
+    char line[80];
+
+    for (size_t h = 0; h < hits.size(); h++)
+    {
+        long long at = hits[h];
+        int len = snprintf(line, sizeof(line), "  match at char #%lld (0x%llx)\n", at, (unsigned long long)at);
+        out.Write(line, len);
+
+        if (dumpSrc != NULL)
+        {
+            long long start = at > g_config.numColWidth ? at - g_config.numColWidth : 0;
+            long long end = at + n + g_config.numColWidth < dumpSrc->Size() ? at + n + g_config.numColWidth : dumpSrc->Size();
+            out.Write("\n", 1);
+            DumpRange(*dumpSrc, start, end, LLONG_MAX, out);
+        }
+    }
+}
+
+/***************************************************************************
+   Run scan over bytes [start, end) of the numPaths files (read side by
+   side) and hand its hits to print in file order. With more than one
+   thread the range is cut into pieces that workers scan independently,
+   each reading on past its end by overlap bytes so that matches starting
+   near the end are complete; a piece's hits are printed as soon as it and
+   all earlier pieces are done. Streams, and short ranges, are scanned by
+   this thread in one forward pass.
+
+   scan(src, pos, scanEnd, reportEnd, hits), with src[] a source for each
+   file, adds the hits that start in [pos, reportEnd) and returns where it
+   stopped (before scanEnd only when a stream ends) or -1 on a read error.
+   Returns the number of hits, or -1 on error.
+***************************************************************************/
+
+#define BYTES_MAX_SCAN_FILES    2
+
+template <typename Hit, typename Scan, typename Print>
+long long ScanInPieces(char** paths, int numPaths, long long start, long long end, long long overlap, Scan scan, Print print)
+{
+    long long pieceSz, numPieces, numHits = 0;
+    int numThreads = g_numThreads;
+    ByteSource src[BYTES_MAX_SCAN_FILES];
+    bool isStream = false;
+
+    for (int f = 0; f < numPaths; f++)
+    {
+        if (!src[f].Open(paths[f]))
+        {
+            HandleFileIOErr(paths[f]);
+            return -1;
+        }
+        isStream = isStream || src[f].IsStream();
+    }
+
+    if (isStream || numThreads <= 1 || end - start <= BYTES_THREAD_BLOCK_SZ)
+    {
+        std::vector<Hit> hits;
+        long long pos, reached;
+
+        for (pos = start; pos < end; pos += BYTES_THREAD_PIECE_SZ)
+        {
+            long long pieceEnd = end - pos > BYTES_THREAD_PIECE_SZ ? pos + BYTES_THREAD_PIECE_SZ : end;
+            long long scanEnd = end - pieceEnd > overlap ? pieceEnd + overlap : end;
+
+            hits.clear();
+            if ((reached = scan(src, pos, scanEnd, pieceEnd, hits)) < 0)
+            {
+                HandleFileIOErr(paths[0]);
+                return -1;
+            }
+            print(hits);
+            numHits += (long long)hits.size();
+            if (reached < pieceEnd)
+                break;      // The stream ended
+        }
+        return numHits;
+    }
+
+    pieceSz = (end - start) / ((long long)numThreads * 4);
+    if (pieceSz < BYTES_THREAD_BLOCK_SZ)
+        pieceSz = BYTES_THREAD_BLOCK_SZ;
+    if (pieceSz > BYTES_THREAD_PIECE_SZ)
+        pieceSz = BYTES_THREAD_PIECE_SZ;
+    numPieces = (end - start + pieceSz - 1) / pieceSz;
+    if (numThreads > numPieces)
+        numThreads = (int)numPieces;
+
+    std::vector<std::vector<Hit> > pieceHits((size_t)numPieces);
+    std::vector<char> pieceDone((size_t)numPieces, 0);
+    std::atomic<long long> nextPiece(0);
+    std::atomic<bool> failed(false);
+    std::mutex doneLock;
+    std::condition_variable doneSignal;
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < numThreads; t++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            ByteSource workerSrc[BYTES_MAX_SCAN_FILES];
+            long long piece;
+
+            for (int f = 0; f < numPaths; f++)
+            {
+                if (!workerSrc[f].Open(paths[f]))
+                    failed = true;
+            }
+
+            while ((piece = nextPiece++) < numPieces)
+            {
+                long long pos = start + piece * pieceSz;
+                long long pieceEnd = end - pos > pieceSz ? pos + pieceSz : end;
+                long long scanEnd = end - pieceEnd > overlap ? pieceEnd + overlap : end;
+
+                if (!failed && scan(workerSrc, pos, scanEnd, pieceEnd, pieceHits[(size_t)piece]) < 0)
+                    failed = true;
+
+                std::lock_guard<std::mutex> lock(doneLock);
+                pieceDone[(size_t)piece] = 1;
+                doneSignal.notify_one();
+            }
+        }));
+    }
+
+    for (long long piece = 0; piece < numPieces; piece++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(doneLock);
+            doneSignal.wait(lock, [&]() { return pieceDone[(size_t)piece] != 0; });
+        }
+        if (!failed)
+            print(pieceHits[(size_t)piece]);
+        numHits += (long long)pieceHits[(size_t)piece].size();
+        std::vector<Hit>().swap(pieceHits[(size_t)piece]);
+    }
+
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    if (failed)
+    {
+        HandleFileIOErr(paths[0]);
+        return -1;
+    }
+    return numHits;
+}
+
+/***************************************************************************
+   Search bytes [start, end) of the file for g_searchPattern and print
+   every match in offset order, and the summary line. Returns 0, or -1 on
+   error.
+***************************************************************************/
+
+int SearchFile(char* filePath, long long fileSz, long long start, long long end)
+{
+    ByteSource dumpSrc;
+    ByteSource* dump = NULL;
+    long long numMatches;
+
+    if (g_searchDump)
+    {
+        if (fileSz < 0)
+            fprintf(stderr, "  -d needs a file; only match offsets are printed for a stream\n");
+        else if (dumpSrc.Open(filePath))
+            dump = &dumpSrc;
+    }
+
+    OutputBuffer out;
+
+    numMatches = ScanInPieces<long long>(&filePath, 1, start, end, (long long)g_searchPattern.size() - 1,
+        [](ByteSource* src, long long pos, long long scanEnd, long long reportEnd, std::vector<long long>& hits)
+        {
+            return SearchRange(src[0], pos, scanEnd, reportEnd, hits);
+        },
+        [&](const std::vector<long long>& hits) { PrintSearchHits(hits, dump, out); });
+    if (numMatches < 0)
+        return -1;
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "\n  %lld match%s\n", numMatches, numMatches == 1 ? "" : "es");
+    out.Write(line, len);
+    return 0;
+}
+
+/***************************************************************************
+   Text views (-U, -U8, -U16le, -U16be). UTF-8 is shown a byte per cell
+   and UTF-16 a code unit per two cells, with the code unit's value below
+   and the decoded character above the cell where it starts (a UTF-8
+   sequence or a surrogate pair shows once, over its first unit). Controls
+   are blank, as in the byte dump; bytes or units that do not decode are
+   shown as U+FFFD, counted, and the first one's offset is reported.
+
+   Text is mostly ASCII, so the view first measures how much of a row is
+   ASCII with a SIMD kernel and copies the pre-rendered byte cells for that
+   part; only the rest is decoded one character at a time.
+***************************************************************************/
+
+/* Length in bytes of the prefix of data whose 16 bit little endian lanes
+   all have no bit of mask set: 0x8080 finds ASCII bytes, 0xFF80 ASCII
+   UTF-16LE units and 0x80FF ASCII UTF-16BE units. len is even. */
+
+typedef size_t (*AsciiKernel)(const unsigned char* data, size_t len, uint16_t mask);
+
+size_t AsciiPrefixScalar(const unsigned char* data, size_t len, uint16_t mask)
+{
+    size_t i = 0;
+    uint64_t mask64 = mask * 0x0001000100010001ULL;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        if ((Load64LE(data + i) & mask64) != 0)
+            break;
+    }
+    for (; i + 2 <= len; i += 2)
+    {
+        if (((data[i] | data[i + 1] << 8) & mask) != 0)
+            break;
+    }
+    return i;
+}
+
+#if defined(BYTES_X86)
+
+BYTES_TARGET("sse2")
+size_t AsciiPrefixSSE2(const unsigned char* data, size_t len, uint16_t mask)
+{
+    __m128i m = _mm_set1_epi16((short)mask), zero = _mm_setzero_si128();
+    unsigned bad;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data + i)), m);
+        if ((bad = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) & 0xFFFF) != 0)
+            return i + (CountTrailingZeros(bad) & ~1);
+    }
+    return i + AsciiPrefixScalar(data + i, len - i, mask);
+}
+
+BYTES_TARGET("avx2")
+size_t AsciiPrefixAVX2(const unsigned char* data, size_t len, uint16_t mask)
+{
+    __m256i m = _mm256_set1_epi16((short)mask), zero = _mm256_setzero_si256();
+    unsigned bad;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(data + i)), m);
+        if ((bad = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, zero))) != 0)
+            return i + (CountTrailingZeros(bad) & ~1);
+    }
+    return i + AsciiPrefixScalar(data + i, len - i, mask);
+}
+
+#endif // BYTES_X86
+
+#if defined(BYTES_ARM64)
+
+size_t AsciiPrefixNEON(const unsigned char* data, size_t len, uint16_t mask)
+{
+    uint16x8_t m = vdupq_n_u16(mask);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        uint16x8_t bad = vtstq_u16(vreinterpretq_u16_u8(vld1q_u8(data + i)), m);
+        uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(bad, 4)), 0);
+        if (bits != 0)
+            return i + (CountTrailingZeros(bits) >> 3) * 2;
+    }
+    return i + AsciiPrefixScalar(data + i, len - i, mask);
+}
+
+#endif // BYTES_ARM64
+
+struct AsciiKernelInfo
+{
+    const char*     name;
+    AsciiKernel     func;
+    const bool*     available;  // NULL if always available
+};
+
+static const AsciiKernelInfo g_asciiKernels[] =
+{
+    { "scalar", AsciiPrefixScalar,  NULL },
+#if defined(BYTES_X86)
+    { "sse2",   AsciiPrefixSSE2,    NULL },
+    { "avx2",   AsciiPrefixAVX2,    &g_cpuHasAvx2 },
+#endif
+#if defined(BYTES_ARM64)
+    { "neon",   AsciiPrefixNEON,    NULL },
+#endif
+};
+
+static const int g_numAsciiKernels = sizeof(g_asciiKernels) / sizeof(g_asciiKernels[0]);
+
+AsciiKernel SelectAsciiKernel()
+{
+    int k;
+
+    for (k = g_numAsciiKernels - 1; k > 0; k--)
+    {
+        if (g_asciiKernels[k].available == NULL || *g_asciiKernels[k].available)
+            break;
+    }
+    return g_asciiKernels[k].func;
+}
+
+#define BYTES_REPLACEMENT_CHAR  0xFFFD
+
+/* Decode the UTF-8 sequence at data[0, len) into *cp. Returns its length,
+   or 0 if data[0] does not start a valid sequence (or it is cut off by
+   len, which is only the case at the end of the input). */
+
+static size_t DecodeUTF8(const unsigned char* data, size_t len, uint32_t* cp)
+{
+    unsigned char c = data[0];
+    size_t n;
+    uint32_t min;
+
+    if (c < 0x80)
+    {
+        *cp = c;
+        return 1;
+    }
+    else if (c >= 0xC2 && c <= 0xDF)
+        n = 2, min = 0x80, *cp = c & 0x1F;
+    else if (c >= 0xE0 && c <= 0xEF)
+        n = 3, min = 0x800, *cp = c & 0x0F;
+    else if (c >= 0xF0 && c <= 0xF4)
+        n = 4, min = 0x10000, *cp = c & 0x07;
+    else
+        return 0;
+
+    if (n > len)
+        return 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        if ((data[i] & 0xC0) != 0x80)
+            return 0;
+        *cp = (*cp << 6) | (data[i] & 0x3F);
+    }
+
+    // Overlong forms, surrogates and values past U+10FFFF are invalid
+    if (*cp < min || (*cp >= 0xD800 && *cp <= 0xDFFF) || *cp > 0x10FFFF)
+        return 0;
+    return n;
+}
+
+// Render the character cell for code point cp, cellWidth columns wide with
+// the character at the right, and return its length in bytes
+static size_t CharCell(uint32_t cp, size_t cellWidth, char* out)
+{
+    size_t pad = cellWidth - 1;
+
+    memset(out, ' ', pad);
+    out += pad;
+
+    // Controls (C0, DEL and C1) and the byte order mark are left blank
+    if (cp < 0x20 || (cp >= 0x7F && cp <= 0x9F) || cp == 0xFEFF)
+    {
+        *out = ' ';
+        return cellWidth;
+    }
+    if (cp < 0x80)
+    {
+        *out = (char)cp;
+        return cellWidth;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return pad + 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return pad + 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return pad + 4;
+}
+
+struct TextViewState
+{
+    int         encoding;       // BYTES_UTF8, BYTES_UTF16LE or BYTES_UTF16BE
+    AsciiKernel ascii;
+    size_t      skip;           // Bytes of a character begun in the last row
+    long long   numInvalid;
+    long long   firstInvalid;
+};
+
+/* Format one row of the text view: n bytes of data, of which the first
+   avail (>= n) may be looked at to finish a character. pos is the offset
+   of data[0]. Returns the length of the text. */
+
+size_t FormatTextRow(TextViewState& state, const unsigned char* data, size_t n, size_t avail, long long pos, char* out)
+{
+    bool isUTF8 = state.encoding == BYTES_UTF8;
+    bool isBigEndian = state.encoding == BYTES_UTF16BE;
+    size_t unitSz = isUTF8 ? 1 : 2, cellWidth = unitSz * BYTES_CELL_WIDTH;
+    size_t numUnits = n / unitSz, asciiUnits, u, i;
+    const char (*numCells)[BYTES_CELL_WIDTH] = g_config.numberFormat == BYTES_HEX_FORMAT ? g_hexCells : g_decCells;
+    char* chars = out;
+    char* p;
+
+    // The ASCII prefix of the row, in units
+    asciiUnits = state.ascii(data, numUnits * unitSz & ~(size_t)1, isUTF8 ? 0x8080 : isBigEndian ? 0x80FF : 0xFF80) / unitSz;
+    while (isUTF8 && asciiUnits < numUnits && data[asciiUnits] < 0x80)
+        asciiUnits++;
+    if (asciiUnits * unitSz < state.skip)
+        asciiUnits = 0;     // The row starts inside a character
+
+    // Character line
+    p = chars;
+    if (isUTF8)
+    {
+        g_cellKernel->chars(data, asciiUnits, p);
+        p += asciiUnits * BYTES_CELL_WIDTH;
+    }
+    else
+    {
+        for (u = 0; u < asciiUnits; u++, p += cellWidth)
+        {
+            memset(p, ' ', BYTES_CELL_WIDTH);
+            memcpy(p + BYTES_CELL_WIDTH, g_charCells[data[2 * u + (isBigEndian ? 1 : 0)]], BYTES_CELL_WIDTH);
+        }
+    }
+
+    for (i = asciiUnits * unitSz; i < n; )
+    {
+        uint32_t cp;
+        size_t len;
+
+        // Units of a character shown earlier are blank
+        if (state.skip > 0)
+        {
+            memset(p, ' ', cellWidth);
+            p += cellWidth;
+            i += unitSz;
+            state.skip -= unitSz;
+            continue;
+        }
+
+        if (isUTF8)
+            len = DecodeUTF8(data + i, avail - i, &cp);
+        else
+        {
+            uint32_t unit = isBigEndian ? data[i] << 8 | data[i + 1] : data[i] | data[i + 1] << 8;
+
+            cp = unit;
+            len = 2;
+            if (unit >= 0xDC00 && unit <= 0xDFFF)
+                len = 0;    // A low surrogate on its own
+            else if (unit >= 0xD800 && unit <= 0xDBFF)
+            {
+                uint32_t low = 0;
+
+                if (i + 4 <= avail)
+                    low = isBigEndian ? data[i + 2] << 8 | data[i + 3] : data[i + 2] | data[i + 3] << 8;
+                if (low >= 0xDC00 && low <= 0xDFFF)
+                {
+                    cp = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    len = 4;
+                }
+                else
+                    len = 0;
+            }
+        }
+
+        if (len == 0)
+        {
+            if (state.numInvalid++ == 0)
+                state.firstInvalid = pos + (long long)i;
+            cp = BYTES_REPLACEMENT_CHAR;
+            len = unitSz;
+        }
+
+        p += CharCell(cp, cellWidth, p);
+        i += unitSz;
+        state.skip = len - unitSz;
+    }
+    *p++ = '\n';
+
+    // Code unit line
+    if (isUTF8)
+    {
+        if (g_config.numberFormat == BYTES_HEX_FORMAT)
+            g_cellKernel->hex(data, n, p);
+        else
+            g_cellKernel->dec(data, n, p);
+        p += n * BYTES_CELL_WIDTH;
+    }
+    else
+    {
+        for (u = 0; u < numUnits; u++, p += cellWidth)
+        {
+            unsigned hi = data[2 * u + (isBigEndian ? 0 : 1)], lo = data[2 * u + (isBigEndian ? 1 : 0)];
+            char cell[16];
+
+            if (hi == 0)
+            {
+                memset(p, ' ', BYTES_CELL_WIDTH);
+                memcpy(p + BYTES_CELL_WIDTH, numCells[lo], BYTES_CELL_WIDTH);
+                continue;
+            }
+            snprintf(cell, sizeof(cell), g_config.numberFormat == BYTES_HEX_FORMAT ? "%8X" : "%8u", hi << 8 | lo);
+            memcpy(p, cell, cellWidth);
+        }
+    }
+    *p++ = '\n';
+    *p++ = '\n';
+
+    return p - out;
+}
+
+// The most a text row of n bytes can take: four bytes of UTF-8 per
+// character cell, plus the code unit line
+static inline size_t FormattedTextRowSize(size_t n)
+{
+    return n * (BYTES_CELL_WIDTH + 4) + n * BYTES_CELL_WIDTH + 3;
+}
+
+/***************************************************************************
+   Print bytes [start, end) of src as text in g_textEncoding, -w bytes
+   per row (rounded down to whole UTF-16 units), stopping after
+   maxLines rows. -U picks UTF-16LE or BE by the byte order mark at the
+   start of the file, LE if there is none.
+***************************************************************************/
+
+void DumpTextRange(ByteSource& src, long long start, long long end, long long maxLines, OutputBuffer& out)
+{
+    TextViewState state = { g_textEncoding, SelectAsciiKernel(), 0, 0, -1 };
+    size_t width = (size_t)g_config.numColWidth, unitSz;
+    const char* how = "";
+    const unsigned char* data;
+    std::vector<unsigned char> buff;
+    long long pos, linesPrinted = 0;
+    size_t got, off, rowLen, lookahead = 3;   // The rest of a 4 byte character
+    char line[160];
+    int len;
+
+    if (state.encoding == BYTES_UNICODE)
+    {
+        // The byte order mark, if the file has one
+        state.encoding = BYTES_UTF16LE;
+        how = ", no byte order mark";
+        if (src.Seek(0) && src.Next(&data, 2) == 2 && ((data[0] == 0xFE && data[1] == 0xFF) || (data[0] == 0xFF && data[1] == 0xFE)))
+        {
+            state.encoding = data[0] == 0xFE ? BYTES_UTF16BE : BYTES_UTF16LE;
+            how = ", from the byte order mark";
+        }
+    }
+
+    unitSz = state.encoding == BYTES_UTF8 ? 1 : 2;
+    width = width / unitSz * unitSz;
+    if (width < unitSz)
+        width = unitSz;
+    start -= start % (long long)unitSz;
+
+    len = snprintf(line, sizeof(line), "  %s%s\n\n",
+                   state.encoding == BYTES_UTF8 ? "UTF-8" : state.encoding == BYTES_UTF16BE ? "UTF-16BE" : "UTF-16LE", how);
+    out.Write(line, len);
+
+    // Rows are cut from a buffer that keeps a few bytes past the last
+    // row, so a character that runs on into the next row can be decoded
+    if (!src.Seek(start))
+        return;
+    for (pos = start; pos < end && linesPrinted < maxLines; )
+    {
+        long long want = BYTES_READ_BUFF_SZ / width * width;
+        bool isLast;
+
+        if (maxLines - linesPrinted < want / (long long)width)
+            want = (maxLines - linesPrinted) * (long long)width + (long long)lookahead;
+        want -= (long long)buff.size();
+        if (want > end - pos - (long long)buff.size())
+            want = end - pos - (long long)buff.size();
+        if (want > 0)
+        {
+            if ((got = src.Next(&data, (size_t)want)) != (size_t)want)
+            {
+                if (!src.IsStream() || src.Failed())
+                    throw Exception("Error reading file!");
+                end = pos + (long long)buff.size() + (long long)got;
+            }
+            buff.insert(buff.end(), data, data + got);
+        }
+        isLast = pos + (long long)buff.size() >= end;
+
+        PhaseTimer timer(BYTES_PHASE_FORMAT);
+        for (off = 0; off < buff.size() && linesPrinted < maxLines; off += rowLen, linesPrinted++)
+        {
+            rowLen = buff.size() - off < width ? buff.size() - off : width;
+            if (!isLast && buff.size() - off < width + lookahead)
+                break;
+            out.Commit(FormatTextRow(state, &buff[off], rowLen, buff.size() - off, pos + (long long)off,
+                                     out.Reserve(FormattedTextRowSize(rowLen))));
+        }
+        CountProcessed((long long)off);
+        pos += (long long)off;
+        buff.erase(buff.begin(), buff.begin() + (long)off);
+        if (isLast && buff.empty())
+            break;
+    }
+
+    if (state.numInvalid > 0)
+    {
+        len = snprintf(line, sizeof(line), "  Invalid %s: %lld, the first at char #%lld\n",
+                       unitSz == 1 ? "bytes" : "code units", state.numInvalid, state.firstInvalid);
+        out.Write(line, len);
+    }
+}
+
+/***************************************************************************
+   Signature scan (-g). The magic bytes of many file formats are looked
+   for in a single pass with an Aho-Corasick automaton, so the cost does
+   not grow with the number of signatures. A signature with an offset is
+   one whose magic sits that far into the file it starts, e.g. "ustar" 257
+   bytes into a tar header; its hits are reported where that file starts.
+***************************************************************************/
+
+struct Signature
+{
+    std::string                 name;
+    std::vector<unsigned char>  magic;
+    long long                   offset;
+};
+
+static const struct { const char* name; const char* hex; long long offset; } g_builtinSignatures[] =
+{
+    { "ZIP",            "504B0304",                         0 },
+    { "ZIP-empty",      "504B0506",                         0 },
+    { "PNG",            "89504E470D0A1A0A",                 0 },
+    { "ELF",            "7F454C46",                         0 },
+    { "gzip",           "1F8B08",                           0 },
+    { "PDF",            "255044462D",                       0 },
+    { "JPEG",           "FFD8FFE0",                         0 },
+    { "JPEG",           "FFD8FFE1",                         0 },
+    { "JPEG",           "FFD8FFDB",                         0 },
+    { "JPEG",           "FFD8FFEE",                         0 },
+    { "GIF",            "474946383761",                     0 },
+    { "GIF",            "474946383961",                     0 },
+    { "bzip2",          "425A683931415926",                 0 },
+    { "bzip2",          "425A683631415926",                 0 },
+    { "bzip2",          "425A683131415926",                 0 },
+    { "xz",             "FD377A585A00",                     0 },
+    { "7z",             "377ABCAF271C",                     0 },
+    { "RAR",            "526172211A0700",                   0 },
+    { "RAR5",           "526172211A070100",                 0 },
+    { "zstd",           "28B52FFD",                         0 },
+    { "LZ4",            "04224D18",                         0 },
+    { "SQLite",         "53514C69746520666F726D6174203300", 0 },
+    { "Mach-O",         "FEEDFACE",                         0 },
+    { "Mach-O",         "FEEDFACF",                         0 },
+    { "Mach-O",         "CEFAEDFE",                         0 },
+    { "Mach-O",         "CFFAEDFE",                         0 },
+    { "class/Mach-O-fat", "CAFEBABE",                       0 },
+    { "CAB",            "4D53434600000000",                 0 },
+    { "OGG",            "4F67675300",                       0 },
+    { "tar",            "7573746172",                     257 },
+    { "RIFF",           "52494646",                         0 },
+    { "MP4/MOV",        "66747970",                         4 },
+    { "OLE2",           "D0CF11E0A1B11AE1",                 0 },
+    { "FLAC",           "664C614300000022",                 0 },
+    { "Windows-PE",     "50450000",                         0 },
+};
+
+/***************************************************************************
+   Read extra signatures from filePath, one per line: a name, the magic
+   bytes in hex and optionally the offset of the magic in its file, e.g.
+   "Foo  CAFEF00D  8". Blank lines and lines starting with '#' are
+   skipped. Returns false if the file can't be read or has a bad line.
+***************************************************************************/
+
+bool LoadSignatures(const char* filePath, std::vector<Signature>& sigs)
+{
+    char line[1024], name[256], hex[512];
+    long long offset;
+    int lineNum = 0, fields;
+    FILE* file = fopen(filePath, "r");
+
+    if (file == NULL)
+    {
+        HandleFileIOErr(const_cast<char*>(filePath));
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        Signature sig;
+
+        lineNum++;
+        offset = 0;
+        fields = sscanf(line, "%255s %511s %lld", name, hex, &offset);
+        if (fields <= 0 || name[0] == '#')
+            continue;
+        if (fields < 2 || offset < 0 || !ParseHexPattern(hex, sig.magic))
+        {
+            fprintf(stderr, "  %s(%d): expected \"name hex-bytes [offset]\"\n", filePath, lineNum);
+            fclose(file);
+            return false;
+        }
+        sig.name = name;
+        sig.offset = offset;
+        sigs.push_back(sig);
+    }
+
+    fclose(file);
+    return true;
+}
+
+/***************************************************************************
+   The automaton as a full transition table: 256 next states per state.
+   States from which a signature has just been completed have
+   BYTES_AC_MATCH set in the entries that lead to them, so the scan loop
+   only looks up the signature list on a hit.
+***************************************************************************/
+
+#define BYTES_AC_MATCH          0x80000000u
+
+class SignatureMatcher
+{
+public:
+    void Build(const std::vector<Signature>& sigs);
+    long long Scan(ByteSource& src, long long pos, long long end, long long reportEnd,
+                   std::vector<std::pair<long long, int> >& hits) const;
+
+    size_t LongestMagic() const     { return m_longest; }
+
+private:
+    std::vector<uint32_t>           m_next;     // [state * 256 + byte]
+    std::vector<std::vector<int> >  m_output;   // signatures ending at a state
+    const std::vector<Signature>*   m_sigs;
+    size_t                          m_longest;
+};
+
+void SignatureMatcher::Build(const std::vector<Signature>& sigs)
+{
+    std::vector<uint32_t> fail(1, 0), queue;
+    uint32_t state, next;
+
+    m_sigs = &sigs;
+    m_longest = 0;
+    m_next.assign(256, 0);
+    m_output.assign(1, std::vector<int>());
+
+    // The trie; 0 doubles as "no edge yet" since nothing leads back to the root
+    for (size_t s = 0; s < sigs.size(); s++)
+    {
+        state = 0;
+        for (size_t i = 0; i < sigs[s].magic.size(); i++)
+        {
+            uint32_t& edge = m_next[state * 256 + sigs[s].magic[i]];
+            if (edge == 0)
+            {
+                edge = (uint32_t)m_output.size();
+                m_next.resize(m_next.size() + 256, 0);
+                m_output.push_back(std::vector<int>());
+                fail.push_back(0);
+            }
+            state = m_next[state * 256 + sigs[s].magic[i]];
+        }
+        m_output[state].push_back((int)s);
+        m_longest = std::max(m_longest, sigs[s].magic.size());
+    }
+
+    // Breadth first, fill in the missing edges from the failure links and
+    // collect the outputs of each state's proper suffixes
+    for (int c = 0; c < 256; c++)
+    {
+        if ((next = m_next[c]) != 0)
+            queue.push_back(next);
+    }
+    for (size_t q = 0; q < queue.size(); q++)
+    {
+        state = queue[q];
+        m_output[state].insert(m_output[state].end(), m_output[fail[state]].begin(), m_output[fail[state]].end());
+
+        for (int c = 0; c < 256; c++)
+        {
+            uint32_t& edge = m_next[state * 256 + c];
+            if (edge != 0)
+            {
+                fail[edge] = m_next[fail[state] * 256 + c];
+                queue.push_back(edge);
+            }
+            else
+                edge = m_next[fail[state] * 256 + c];
+        }
+    }
+
+    for (size_t e = 0; e < m_next.size(); e++)
+    {
+        if (!m_output[m_next[e]].empty())
+            m_next[e] |= BYTES_AC_MATCH;
+    }
+}
+
+/***************************************************************************
+   Run the automaton over bytes [pos, end) of src from the root, adding
+   (file start, signature) for every magic that starts in [pos, reportEnd).
+   Returns where scanning stopped, or -1 on a read error.
+***************************************************************************/
+
+long long SignatureMatcher::Scan(ByteSource& src, long long pos, long long end, long long reportEnd,
+                                 std::vector<std::pair<long long, int> >& hits) const
+{
+    const uint32_t* next = &m_next[0];
+    const unsigned char* data;
+    uint32_t state = 0;
+    size_t got, firstHit = hits.size();
+
+    if (!src.Seek(pos))
+        return src.Failed() ? -1 : pos;
+
+    while (pos < end)
+    {
+        long long want = end - pos < BYTES_READ_BUFF_SZ ? end - pos : BYTES_READ_BUFF_SZ;
+
+        if ((got = src.Next(&data, (size_t)want)) < (size_t)want && (!src.IsStream() || src.Failed()))
+            return -1;
+
+        {
+            PhaseTimer timer(BYTES_PHASE_COMPUTE);
+            for (size_t i = 0; i < got; i++)
+            {
+                state = next[(state & ~BYTES_AC_MATCH) * 256 + data[i]];
+                if ((state & BYTES_AC_MATCH) == 0)
+                    continue;
+
+                const std::vector<int>& out = m_output[state & ~BYTES_AC_MATCH];
+                for (size_t o = 0; o < out.size(); o++)
+                {
+                    const Signature& sig = (*m_sigs)[out[o]];
+                    long long magicPos = pos + (long long)i + 1 - (long long)sig.magic.size();
+
+                    // Skip those whose file would start before the input does
+                    if (magicPos < reportEnd && magicPos >= sig.offset)
+                        hits.push_back(std::make_pair(magicPos - sig.offset, out[o]));
+                }
+            }
+        }
+        CountProcessed((long long)got);
+
+        pos += (long long)got;
+        if (got < (size_t)want)
+            break;
+    }
+
+    // Matches were found in order of where they end
+    std::sort(hits.begin() + firstHit, hits.end());
+    return pos;
+}
+
+/***************************************************************************
+   Scan bytes [start, end) of the file for the built-in signatures and
+   those in sigFilePath (if not NULL), printing every hit in offset order
+   and then a count per format. Returns 0, or -1 on error.
+***************************************************************************/
+
+int ScanSignatures(char* filePath, long long start, long long end, const char* sigFilePath)
+{
+    std::vector<Signature> sigs;
+    SignatureMatcher matcher;
+    long long numHits;
+    char line[320];
+    int len;
+
+    for (size_t i = 0; i < sizeof(g_builtinSignatures) / sizeof(g_builtinSignatures[0]); i++)
+    {
+        Signature sig;
+        sig.name = g_builtinSignatures[i].name;
+        ParseHexPattern(g_builtinSignatures[i].hex, sig.magic);
+        sig.offset = g_builtinSignatures[i].offset;
+        sigs.push_back(sig);
+    }
+    if (sigFilePath != NULL && !LoadSignatures(sigFilePath, sigs))
+        return -1;
+
+    matcher.Build(sigs);
+    std::vector<long long> counts(sigs.size(), 0);
+    OutputBuffer out;
+
+    numHits = ScanInPieces<std::pair<long long, int> >(&filePath, 1, start, end, (long long)matcher.LongestMagic() - 1,
+        [&](ByteSource* src, long long pos, long long scanEnd, long long reportEnd, std::vector<std::pair<long long, int> >& hits)
+        {
+            return matcher.Scan(src[0], pos, scanEnd, reportEnd, hits);
+        },
+        [&](const std::vector<std::pair<long long, int> >& hits)
+        {
+            for (size_t h = 0; h < hits.size(); h++)
+            {
+                long long at = hits[h].first;
+
+                len = snprintf(line, sizeof(line), "  char #%lld (0x%llx)  %s\n", at, (unsigned long long)at,
+                               sigs[hits[h].second].name.c_str());
+                out.Write(line, len);
+                counts[hits[h].second]++;
+            }
+        });
+    if (numHits < 0)
+        return -1;
+
+    // One total per format name, in table order
+    out.Write("\n", 1);
+    for (size_t s = 0; s < sigs.size(); s++)
+    {
+        long long total = 0;
+        size_t first = 0;
+
+        while (sigs[first].name != sigs[s].name)
+            first++;
+        if (first != s)
+            continue;
+        for (size_t t = s; t < sigs.size(); t++)
+            total += sigs[t].name == sigs[s].name ? counts[t] : 0;
+        if (total > 0)
+        {
+            len = snprintf(line, sizeof(line), "  %-18s %lld\n", sigs[s].name.c_str(), total);
+            out.Write(line, len);
+        }
+    }
+
+    numHits = 0;
+    for (size_t s = 0; s < sigs.size(); s++)
+        numHits += counts[s];
+    len = snprintf(line, sizeof(line), "  %lld signature%s found\n", numHits, numHits == 1 ? "" : "s");
+    out.Write(line, len);
+    return 0;
+}
+
+/***************************************************************************
+   Compare mode (-D). Both files are read side by side in large blocks and
+   compared many bytes at a time for the first mismatch. Differences less
+   than a row apart are coalesced into one range, and each range is
+   printed with the rows of the two files next to each other.
+***************************************************************************/
+
+typedef size_t (*MismatchFinder)(const unsigned char* a, const unsigned char* b, size_t n);
+
+// Index of the first byte where a and b differ, or n if they are equal
+size_t FindMismatchScalar(const unsigned char* a, const unsigned char* b, size_t n)
+{
+    size_t i = 0;
+    uint64_t x, y;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y)
+            break;
+    }
+    while (i < n && a[i] == b[i])
+        i++;
+    return i;
+}
+
+#if defined(BYTES_X86)
+
+BYTES_TARGET("sse2")
+size_t FindMismatchSSE2(const unsigned char* a, const unsigned char* b, size_t n)
+{
+    size_t i = 0;
+    unsigned mask;
+
+    for (; i + 64 <= n; i += 64)
+    {
+        __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),      _mm_loadu_si128((const __m128i*)(b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 16)), _mm_loadu_si128((const __m128i*)(b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 32)), _mm_loadu_si128((const __m128i*)(b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 48)), _mm_loadu_si128((const __m128i*)(b + i + 48)));
+        if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3))) != 0xFFFF)
+            break;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                                          _mm_loadu_si128((const __m128i*)(b + i))));
+        if (mask != 0xFFFF)
+            return i + CountTrailingZeros(~mask);
+    }
+    return i + FindMismatchScalar(a + i, b + i, n - i);
+}
+
+BYTES_TARGET("avx2")
+size_t FindMismatchAVX2(const unsigned char* a, const unsigned char* b, size_t n)
+{
+    size_t i = 0;
+    unsigned mask;
+
+    for (; i + 128 <= n; i += 128)
+    {
+        __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)),      _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+        __m256i e2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 64)), _mm256_loadu_si256((const __m256i*)(b + i + 64)));
+        __m256i e3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 96)), _mm256_loadu_si256((const __m256i*)(b + i + 96)));
+        if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(e0, e1), _mm256_and_si256(e2, e3))) != 0xFFFFFFFFu)
+            break;
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                                                _mm256_loadu_si256((const __m256i*)(b + i))));
+        if (mask != 0xFFFFFFFFu)
+            return i + CountTrailingZeros(~mask);
+    }
+    return i + FindMismatchScalar(a + i, b + i, n - i);
+}
+
+#endif // BYTES_X86
+
+#if defined(BYTES_ARM64)
+
+size_t FindMismatchNEON(const unsigned char* a, const unsigned char* b, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64)
+    {
+        uint8x16_t e0 = vceqq_u8(vld1q_u8(a + i),      vld1q_u8(b + i));
+        uint8x16_t e1 = vceqq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16));
+        uint8x16_t e2 = vceqq_u8(vld1q_u8(a + i + 32), vld1q_u8(b + i + 32));
+        uint8x16_t e3 = vceqq_u8(vld1q_u8(a + i + 48), vld1q_u8(b + i + 48));
+        if (vminvq_u8(vandq_u8(vandq_u8(e0, e1), vandq_u8(e2, e3))) != 0xFF)
+            break;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask != ~0ULL)
+            return i + (CountTrailingZeros(~mask) >> 2);
+    }
+    return i + FindMismatchScalar(a + i, b + i, n - i);
+}
+
+#endif // BYTES_ARM64
+
+struct MismatchKernelInfo
+{
+    const char*     name;
+    MismatchFinder  func;
+    const bool*     available;  // NULL if always available
+};
+
+static const MismatchKernelInfo g_mismatchKernels[] =
+{
+    { "scalar", FindMismatchScalar, NULL },
+#if defined(BYTES_X86)
+    { "sse2",   FindMismatchSSE2,   NULL },
+    { "avx2",   FindMismatchAVX2,   &g_cpuHasAvx2 },
+#endif
+#if defined(BYTES_ARM64)
+    { "neon",   FindMismatchNEON,   NULL },
+#endif
+};
+
+static const int g_numMismatchKernels = sizeof(g_mismatchKernels) / sizeof(g_mismatchKernels[0]);
+
+MismatchFinder SelectMismatchKernel()
+{
+    int k;
+
+    for (k = g_numMismatchKernels - 1; k > 0; k--)
+    {
+        if (g_mismatchKernels[k].available == NULL || *g_mismatchKernels[k].available)
+            break;
+    }
+    return g_mismatchKernels[k].func;
+}
+
+struct DiffRange
+{
+    long long   start;
+    long long   end;
+};
+
+/***************************************************************************
+   Compare bytes [pos, end) of src[0] and src[1], adding the differing
+   ranges to ranges; differences less than gap bytes apart are one range.
+   Returns where the comparison stopped (before end if either input is a
+   stream that ends first), or -1 on a read error.
+***************************************************************************/
+
+long long CompareRange(ByteSource* src, long long pos, long long end, long long gap, std::vector<DiffRange>& ranges)
+{
+    MismatchFinder findMismatch = SelectMismatchKernel();
+    const unsigned char *a, *b;
+    DiffRange open = { -1, -1 };
+    size_t gotA, gotB, n, i;
+
+    if (!src[0].Seek(pos) || !src[1].Seek(pos))
+        return src[0].Failed() || src[1].Failed() ? -1 : pos;
+
+    while (pos < end)
+    {
+        long long want = end - pos < BYTES_READ_BUFF_SZ ? end - pos : BYTES_READ_BUFF_SZ;
+
+        gotA = src[0].Next(&a, (size_t)want);
+        gotB = src[1].Next(&b, (size_t)want);
+        if (src[0].Failed() || src[1].Failed() ||
+            (gotA < (size_t)want && !src[0].IsStream()) || (gotB < (size_t)want && !src[1].IsStream()))
+            return -1;
+        n = gotA < gotB ? gotA : gotB;
+
+        {
+            PhaseTimer timer(BYTES_PHASE_COMPUTE);
+            for (i = 0; (i += findMismatch(a + i, b + i, n - i)) < n; i++)
+            {
+                long long at = pos + (long long)i;
+                if (open.end >= 0 && at - open.end < gap)
+                    open.end = at + 1;
+                else
+                {
+                    if (open.end >= 0)
+                        ranges.push_back(open);
+                    open.start = at;
+                    open.end = at + 1;
+                }
+            }
+        }
+        CountProcessed(2 * (long long)n);
+
+        pos += (long long)n;
+        if (n < (size_t)want)
+            break;
+    }
+
+    if (open.end >= 0)
+        ranges.push_back(open);
+    return pos;
+}
+
+/***************************************************************************
+   Print rows [start, end) of both files next to each other, file A's
+   cells, " | ", then file B's, width bytes per side, at most maxRows rows.
+***************************************************************************/
+
+void DumpRangePair(ByteSource* src, long long start, long long end, size_t width, long long maxRows, OutputBuffer& out)
+{
+    const unsigned char *a, *b;
+    size_t rowsPerFetch = BYTES_READ_BUFF_SZ / width, gotA, gotB, off, rowLen, side;
+    long long pos, rows = 0;
+
+    if (rowsPerFetch < 1)
+        rowsPerFetch = 1;
+    if (!src[0].Seek(start) || !src[1].Seek(start))
+        return;
+
+    for (pos = start; pos < end && rows < maxRows; pos += (long long)gotA)
+    {
+        long long want = (long long)(rowsPerFetch * width);
+        if (want > end - pos)
+            want = end - pos;
+        if (maxRows - rows < (want + (long long)width - 1) / (long long)width)
+            want = (maxRows - rows) * (long long)width;
+
+        if ((gotA = src[0].Next(&a, (size_t)want)) != (size_t)want || (gotB = src[1].Next(&b, (size_t)want)) != (size_t)want)
+            throw Exception("Error reading file!");
+
+        PhaseTimer timer(BYTES_PHASE_FORMAT);
+        for (off = 0; off < gotA; off += rowLen, rows++)
+        {
+            rowLen = gotA - off < width ? gotA - off : width;
+            side = width * BYTES_CELL_WIDTH;
+
+            char* p = out.Reserve(2 * (2 * side + 3) + 2);
+            char* rowStart = p;
+            memset(p, ' ', 2 * (2 * side + 3) + 2);
+
+            g_cellKernel->chars(a + off, rowLen, p);
+            p[side] = ' ';  p[side + 1] = '|';
+            g_cellKernel->chars(b + off, rowLen, p + side + 3);
+            p += 2 * side + 3;
+            *p++ = '\n';
+
+            if (g_config.numberFormat == BYTES_HEX_FORMAT)
+            {
+                g_cellKernel->hex(a + off, rowLen, p);
+                g_cellKernel->hex(b + off, rowLen, p + side + 3);
+            }
+            else
+            {
+                g_cellKernel->dec(a + off, rowLen, p);
+                g_cellKernel->dec(b + off, rowLen, p + side + 3);
+            }
+            p[side + 1] = '|';
+            p += 2 * side + 3;
+            *p++ = '\n';
+            *p++ = '\n';
+            out.Commit(p - rowStart);
+        }
+    }
+}
+
+/***************************************************************************
+   Compare bytes [start, end) of two files and print every range where
+   they differ, with at most g_linesToPrint side by side rows each, then
+   whether their sizes differ. Rows have half of -w bytes per file so
+   the pair is as wide as a normal dump. Returns 0 if the ranges are
+   the same, 1 if not, -1 on error.
+***************************************************************************/
+
+int CompareFiles(char** paths, long long start, long long end)
+{
+    size_t width = g_config.numColWidth > 1 ? (size_t)g_config.numColWidth / 2 : 1;
+    long long numRanges, diffBytes = 0, sizes[2];
+    ByteSource dumpSrc[2];
+    bool canDump = true;
+    DiffRange pending = { -1, -1 };
+    char line[160];
+    int len;
+
+    for (int f = 0; f < 2; f++)
+    {
+        if (!dumpSrc[f].Open(paths[f]))
+        {
+            HandleFileIOErr(paths[f]);
+            return -1;
+        }
+        sizes[f] = dumpSrc[f].Size();
+        if (dumpSrc[f].IsStream())
+            canDump = false;    // What has been compared is gone
+        else if (end > sizes[f])
+            end = sizes[f];
+    }
+
+    OutputBuffer out;
+
+    auto printRange = [&](const DiffRange& range)
+    {
+        long long rows = (range.end - range.start + (long long)width - 1) / (long long)width;
+
+        diffBytes += range.end - range.start;
+        len = snprintf(line, sizeof(line), "  differ at char #%lld to #%lld (%lld bytes)\n\n",
+                       range.start, range.end - 1, range.end - range.start);
+        out.Write(line, len);
+        if (!canDump)
+            return;
+
+        DumpRangePair(dumpSrc, range.start, range.end, width, g_linesToPrint, out);
+        if (rows > g_linesToPrint)
+        {
+            len = snprintf(line, sizeof(line), "    ... %lld more rows\n\n", rows - g_linesToPrint);
+            out.Write(line, len);
+        }
+    };
+
+    // Ranges found in different pieces are joined here if they are close
+    numRanges = ScanInPieces<DiffRange>(paths, 2, start, end, 0,
+        [&](ByteSource* src, long long pos, long long scanEnd, long long, std::vector<DiffRange>& ranges)
+        {
+            return CompareRange(src, pos, scanEnd, (long long)width, ranges);
+        },
+        [&](const std::vector<DiffRange>& ranges)
+        {
+            for (size_t r = 0; r < ranges.size(); r++)
+            {
+                if (pending.end >= 0 && ranges[r].start - pending.end < (long long)width)
+                    pending.end = ranges[r].end;
+                else
+                {
+                    if (pending.end >= 0)
+                        printRange(pending);
+                    pending = ranges[r];
+                }
+            }
+        });
+    if (numRanges < 0)
+        return -1;
+    if (pending.end >= 0)
+        printRange(pending);
+
+    if (diffBytes == 0)
+        out.Write("  no differences\n", 17);
+    else
+    {
+        len = snprintf(line, sizeof(line), "  %lld bytes differ\n", diffBytes);
+        out.Write(line, len);
+    }
+    if (sizes[0] >= 0 && sizes[1] >= 0 && sizes[0] != sizes[1])
+    {
+        int longer = sizes[0] > sizes[1] ? 0 : 1;
+        len = snprintf(line, sizeof(line), "  %s is %lld bytes longer\n", paths[longer], sizes[longer] - sizes[1 - longer]);
+        out.Write(line, len);
+    }
+
+    return diffBytes == 0 && sizes[0] == sizes[1] ? 0 : 1;
+}
+
+/***************************************************************************
+   Byte profile (-p). Counts how often every byte value occurs, in each
+   block and in the whole range, and prints each block's Shannon entropy
+   (0 bits per byte for a run of one value, 8 for random or encrypted
+   data) and then the histogram and entropy of the whole range.
+***************************************************************************/
+
+/* Add the bytes of data to four sub-histograms, one per byte lane, so
+   that runs of the same value do not make every increment wait for the
+   previous one to be stored. */
+
+void CountBytes(const unsigned char* data, size_t len, uint32_t counts[4][256])
+{
+    size_t i = 0;
+    uint64_t x, y;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        memcpy(&x, data + i, 8);
+        memcpy(&y, data + i + 8, 8);
+        counts[0][x & 0xFF]++;          counts[1][(x >> 8) & 0xFF]++;
+        counts[2][(x >> 16) & 0xFF]++;  counts[3][(x >> 24) & 0xFF]++;
+        counts[0][(x >> 32) & 0xFF]++;  counts[1][(x >> 40) & 0xFF]++;
+        counts[2][(x >> 48) & 0xFF]++;  counts[3][x >> 56]++;
+        counts[0][y & 0xFF]++;          counts[1][(y >> 8) & 0xFF]++;
+        counts[2][(y >> 16) & 0xFF]++;  counts[3][(y >> 24) & 0xFF]++;
+        counts[0][(y >> 32) & 0xFF]++;  counts[1][(y >> 40) & 0xFF]++;
+        counts[2][(y >> 48) & 0xFF]++;  counts[3][y >> 56]++;
+    }
+    for (; i < len; i++)
+        counts[0][data[i]]++;
+}
+
+double ShannonEntropy(const unsigned long long counts[256], long long total)
+{
+    double entropy = 0;
+
+    for (int c = 0; c < 256; c++)
+    {
+        if (counts[c] != 0)
+        {
+            double p = (double)counts[c] / (double)total;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy;
+}
+
+struct BlockProfile
+{
+    long long   start;
+    long long   len;
+    double      entropy;
+};
+
+/***************************************************************************
+   Profile the blocks of [rangeStart, end) that start in [pos, reportEnd),
+   adding each one's entropy to blocks and its counts to totals[]. A block
+   may run on past reportEnd. Returns where reading stopped (before end
+   only if a stream ended), or -1 on a read error.
+***************************************************************************/
+
+long long ProfileRange(ByteSource& src, long long rangeStart, long long pos, long long end, long long reportEnd,
+                       long long blockSz, std::atomic<unsigned long long>* totals, std::vector<BlockProfile>& blocks)
+{
+    const unsigned char* data;
+    uint32_t counts[4][256];
+    unsigned long long blockCounts[256];
+    size_t got;
+
+    // The first block that starts at or after pos
+    pos = rangeStart + (pos - rangeStart + blockSz - 1) / blockSz * blockSz;
+    if (pos >= reportEnd)
+        return end;
+    if (!src.Seek(pos))
+        return src.Failed() ? -1 : pos;
+
+    while (pos < reportEnd && pos < end)
+    {
+        BlockProfile block = { pos, 0, 0 };
+        long long blockEnd = end - pos < blockSz ? end : pos + blockSz;
+
+        memset(counts, 0, sizeof(counts));
+        while (pos < blockEnd)
+        {
+            long long want = blockEnd - pos < BYTES_READ_BUFF_SZ ? blockEnd - pos : BYTES_READ_BUFF_SZ;
+
+            if ((got = src.Next(&data, (size_t)want)) < (size_t)want && (!src.IsStream() || src.Failed()))
+                return -1;
+            {
+                PhaseTimer timer(BYTES_PHASE_COMPUTE);
+                CountBytes(data, got, counts);
+            }
+            CountProcessed((long long)got);
+            pos += (long long)got;
+            if (got < (size_t)want)
+                break;
+        }
+
+        if ((block.len = pos - block.start) == 0)
+            break;
+        for (int c = 0; c < 256; c++)
+        {
+            blockCounts[c] = (unsigned long long)counts[0][c] + counts[1][c] + counts[2][c] + counts[3][c];
+            if (blockCounts[c] != 0)
+                totals[c] += blockCounts[c];
+        }
+        block.entropy = ShannonEntropy(blockCounts, block.len);
+        blocks.push_back(block);
+
+        if (pos < blockEnd)
+            break;      // The stream ended
+    }
+
+    return pos;
+}
+
+/***************************************************************************
+   Profile bytes [start, end) of the file in blocks of blockSz bytes:
+   print one line per block with its entropy and a bar, then the count and
+   share of every byte value and the entropy over the whole range.
+   Returns 0, or -1 on error.
+***************************************************************************/
+
+int ProfileFile(char* filePath, long long start, long long end, long long blockSz)
+{
+    std::atomic<unsigned long long> totals[256];
+    unsigned long long counts[256];
+    long long numBlocks, total = 0;
+    char line[160];
+    int len;
+
+    for (int c = 0; c < 256; c++)
+        totals[c] = 0;
+
+    OutputBuffer out;
+
+    len = snprintf(line, sizeof(line), "  Entropy in bits per byte of each %lld byte block:\n\n", blockSz);
+    out.Write(line, len);
+
+    numBlocks = ScanInPieces<BlockProfile>(&filePath, 1, start, end, blockSz - 1,
+        [&](ByteSource* src, long long pos, long long scanEnd, long long reportEnd, std::vector<BlockProfile>& blocks)
+        {
+            return ProfileRange(src[0], start, pos, scanEnd, reportEnd, blockSz, totals, blocks);
+        },
+        [&](const std::vector<BlockProfile>& blocks)
+        {
+            static const char bar[] = "################################";
+
+            for (size_t b = 0; b < blocks.size(); b++)
+            {
+                int barLen = (int)(blocks[b].entropy * 4 + 0.5);
+                len = snprintf(line, sizeof(line), "  char #%-14lld %6.3f  %.*s\n", blocks[b].start, blocks[b].entropy,
+                               barLen, bar);
+                out.Write(line, len);
+            }
+        });
+    if (numBlocks < 0)
+        return -1;
+
+    for (int c = 0; c < 256; c++)
+        total += (long long)(counts[c] = totals[c]);
+
+    // Four columns of 64 values, down then across
+    len = snprintf(line, sizeof(line), "\n  Byte counts of %lld bytes:\n\n", total);
+    out.Write(line, len);
+    for (int r = 0; r < 64; r++)
+    {
+        for (int c = r; c < 256; c += 64)
+        {
+            len = snprintf(line, sizeof(line), g_config.numberFormat == BYTES_HEX_FORMAT ? "  %02X %c %12llu %6.2f%%" : "  %3u %c %12llu %6.2f%%",
+                           c, isprint(c) && c < 128 ? c : ' ', counts[c], total > 0 ? 100.0 * counts[c] / total : 0.0);
+            out.Write(line, len);
+        }
+        out.Write("\n", 1);
+    }
+
+    len = snprintf(line, sizeof(line), "\n  Entropy: %.4f bits per byte\n", total > 0 ? ShannonEntropy(counts, total) : 0.0);
+    out.Write(line, len);
+    return 0;
+}
+
+/***************************************************************************
+   Multi-range dump (-r, -R). Ranges are given as START-END (the same
+   char numbers as the start and end arguments), START+LEN, or START
+   alone for about a page, separated by commas, spaces or new lines; in
+   a file, # starts a comment. Each range is printed in the order given,
+   under the same header a single dump has. A regular file is mapped once
+   and every range is served from it. A stream can only be read forward,
+   so its ranges are sorted and overlapping ones merged, each merged span
+   is read into memory in file order, and the ranges are printed from
+   there.
+***************************************************************************/
+
+struct DumpRequest
+{
+    long long   start;
+    long long   end;
+    long long   maxLines;
+};
+
+struct Span
+{
+    long long   start;
+    long long   end;
+};
+
+bool ParseRanges(const char* text, std::vector<DumpRequest>& ranges)
+{
+    const char* p = text;
+    char* next;
+
+    for (;;)
+    {
+        while (*p == ',' || isspace((unsigned char)*p))
+            p++;
+        if (*p == '#')
+        {
+            while (*p != 0 && *p != '\n')
+                p++;
+            continue;
+        }
+        if (*p == 0)
+            return true;
+
+        DumpRequest range;
+        range.start = strtoll(p, &next, 0) - 1;
+        if (next == p || range.start < 0)
+            return false;
+        p = next;
+
+        if (*p == '-' || *p == '+')
+        {
+            char sep = *p++;
+            long long n = strtoll(p, &next, 0);
+            if (next == p || n < 0)
+                return false;
+            p = next;
+            range.end = sep == '-' ? n : range.start + n;
+            range.maxLines = LLONG_MAX;
+        }
+        else
+        {
+            range.end = range.start + BYTES_DEF_NUM_COLS * BYTES_DEF_NUM_LINES;
+            range.maxLines = g_linesToPrint;
+        }
+        if (*p != 0 && *p != ',' && *p != '#' && !isspace((unsigned char)*p))
+            return false;
+        ranges.push_back(range);
+    }
+}
+
+bool ReadRangeFile(const char* filePath, std::string& text)
+{
+    char buff[4096];
+    size_t got;
+    FILE* file;
+
+    if ((file = fopen(filePath, "r")) == NULL)
+        return false;
+    while ((got = fread(buff, 1, sizeof(buff), file)) > 0)
+        text.append(buff, got);
+    fclose(file);
+    text += '\n';
+    return true;
+}
+
+/***************************************************************************
+   Dump every range of the -r list and -R file of the file. Returns 0, or
+   -1 on error.
+***************************************************************************/
+
+int DumpRanges(char* filePath, const char* rangeList, const char* rangeFile)
+{
+    std::vector<DumpRequest> ranges;
+    std::string text;
+    ByteSource src;
+    long long size;
+    char line[160];
+    int len;
+
+    if (rangeList != NULL && !ParseRanges(rangeList, ranges))
+        throw Exception("\n  -r needs ranges like 100-200,4096+512,8192\n");
+    if (rangeFile != NULL)
+    {
+        if (!ReadRangeFile(rangeFile, text))
+        {
+            HandleFileIOErr(const_cast<char*>(rangeFile));
+            return -1;
+        }
+        if (!ParseRanges(text.c_str(), ranges))
+            throw Exception("\n  The -R file needs ranges like 100-200, 4096+512 or 8192, one or more per line\n");
+    }
+
+    if (!src.Open(filePath))
+    {
+        HandleFileIOErr(filePath);
+        return -1;
+    }
+    size = src.IsStream() ? LLONG_MAX : src.Size();
+
+    // What each range is printed from: the file itself, or for a stream
+    // the merged span that holds it, read into spanData
+    std::vector<size_t> spanOf(ranges.size(), 0);
+    std::vector<Span> spans;
+    std::vector<std::vector<unsigned char> > spanData;
+
+    for (size_t r = 0; r < ranges.size(); r++)
+    {
+        if (ranges[r].end > size)
+            ranges[r].end = size;
+    }
+
+    if (src.IsStream())
+    {
+        std::vector<size_t> order(ranges.size());
+
+        for (size_t r = 0; r < order.size(); r++)
+            order[r] = r;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ranges[a].start < ranges[b].start; });
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const DumpRequest& range = ranges[order[i]];
+
+            if (range.end <= range.start)
+                continue;
+            if (spans.empty() || range.start > spans.back().end)
+            {
+                Span span = { range.start, range.end };
+                spans.push_back(span);
+            }
+            else if (range.end > spans.back().end)
+                spans.back().end = range.end;
+            spanOf[order[i]] = spans.size() - 1;
+        }
+
+        spanData.resize(spans.size());
+        for (size_t s = 0; s < spans.size(); s++)
+        {
+            const unsigned char* data;
+            size_t got;
+
+            if (!src.Seek(spans[s].start))
+                break;      // The stream ended before this span
+            while (spans[s].start + (long long)spanData[s].size() < spans[s].end &&
+                   (got = src.Next(&data, (size_t)std::min(spans[s].end - spans[s].start - (long long)spanData[s].size(),
+                                                           (long long)BYTES_READ_BUFF_SZ))) > 0)
+                spanData[s].insert(spanData[s].end(), data, data + got);
+            if (src.Failed())
+            {
+                HandleFileIOErr(filePath);
+                return -1;
+            }
+        }
+    }
+
+    OutputBuffer out;
+
+    for (size_t r = 0; r < ranges.size(); r++)
+    {
+        DumpRequest& range = ranges[r];
+
+        if (src.IsStream() && range.end > range.start)
+        {
+            const Span& span = spans[spanOf[r]];
+            long long have = span.start + (long long)spanData[spanOf[r]].size();
+
+            if (range.end > have)
+                range.end = have;
+        }
+
+        if (range.end <= range.start)
+        {
+            len = snprintf(line, sizeof(line), "start at char #%lld is past the end of the input\n\n", range.start);
+            out.Write(line, len);
+            continue;
+        }
+
+        len = snprintf(line, sizeof(line), "start at char #%lld, end at char #%lld\n\n", range.start, range.end);
+        out.Write(line, len);
+
+        if (src.IsStream())
+        {
+            const Span& span = spans[spanOf[r]];
+            DumpRows(&spanData[spanOf[r]][(size_t)(range.start - span.start)], (size_t)(range.end - range.start),
+                     range.maxLines, out);
+            CountProcessed(range.end - range.start);
+        }
+        else
+            DumpRange(src, range.start, range.end, range.maxLines, out);
+        out.Write("\n", 1);
+    }
+
+    return 0;
+}
+
+/***************************************************************************
+   Duplicate chunk report (-u). Files are cut into content-defined chunks
+   with a Gear rolling hash: a chunk ends where the top bits of the hash of
+   the last 64 bytes are all zero, so an insertion or deletion only moves
+   the chunk boundaries near it and identical data elsewhere still yields
+   identical chunks. Each chunk is fingerprinted by its CRC-64/XZ and
+   length and looked up in an open addressing table, which keeps where
+   every distinct chunk was first seen. Every file is also cut at fixed
+   BYTES_THREAD_PIECE_SZ offsets so that pieces can be chunked on several
+   threads and the chunks are the same for any -j.
+***************************************************************************/
+
+struct GearTable
+{
+    uint64_t t[256] = {};
+};
+
+// 256 pseudo random values from the splitmix64 generator
+constexpr GearTable MakeGearTable()
+{
+    GearTable gear;
+    uint64_t x = 0, z = 0;
+
+    for (int i = 0; i < 256; i++)
+    {
+        x += 0x9E3779B97F4A7C15;
+        z = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        gear.t[i] = z ^ (z >> 31);
+    }
+    return gear;
+}
+
+static constexpr GearTable g_gearTable = MakeGearTable();
+
+struct ChunkParams
+{
+    long long   minSz;
+    long long   maxSz;
+    long long   avgSz;
+    uint64_t    threshold;  // Boundary where hash < threshold
+};
+
+// Chunks average about avgSz bytes (rounded down to a power of two), no
+// less than a quarter and no more than four times that. Past minSz a
+// boundary comes every avgSz - minSz bytes on average, which a threshold
+// on the hash can give exactly where a mask of its top bits could not.
+ChunkParams MakeChunkParams(long long avgSz)
+{
+    ChunkParams params;
+    int bits = 0;
+
+    while (((long long)2 << bits) <= avgSz)
+        bits++;
+    params.avgSz = (long long)1 << bits;
+    params.minSz = params.avgSz / 4;
+    params.maxSz = params.avgSz * 4;
+    params.threshold = ~(uint64_t)0 / (uint64_t)(params.avgSz - params.minSz);
+    return params;
+}
+
+struct Chunk
+{
+    long long   start;
+    long long   len;
+    uint64_t    fp;
+};
+
+/***************************************************************************
+   Cut bytes [pos, end) of src into chunks, starting a new chunk at pos,
+   and append them to chunks. Returns false on a read error.
+***************************************************************************/
+
+bool ChunkRange(ByteSource& src, long long pos, long long end, const ChunkParams& params, std::vector<Chunk>& chunks)
+{
+    const uint64_t* gear = g_gearTable.t;
+    // The hash covers only the last 64 bytes, so the bytes before those of
+    // the minimum size need not be hashed
+    long long skipLen = params.minSz > 64 ? params.minSz - 64 : 0;
+    long long chunkStart = pos, chunkLen = 0;
+    uint64_t hash = 0;
+    const unsigned char* data;
+    size_t got, i, segStart;
+    BytesCRC crc, emptyCRC;
+
+    BytesCRCStart(emptyCRC, "crc64xz");
+    crc = emptyCRC;
+
+    if (!src.Seek(pos))
+        return false;
+
+    while (pos < end)
+    {
+        size_t want = (size_t)(end - pos < BYTES_READ_BUFF_SZ ? end - pos : BYTES_READ_BUFF_SZ);
+        if ((got = src.Next(&data, want)) < want)
+            return false;
+
+        PhaseTimer timer(BYTES_PHASE_COMPUTE);
+        for (i = 0, segStart = 0; i < got; )
+        {
+            if (chunkLen < skipLen)
+            {
+                size_t n = skipLen - chunkLen < (long long)(got - i) ? (size_t)(skipLen - chunkLen) : got - i;
+                i += n;
+                chunkLen += (long long)n;
+                continue;
+            }
+
+            bool isCut = false;
+            while (i < got && !isCut)
+            {
+                hash = (hash << 1) + gear[data[i++]];
+                chunkLen++;
+                isCut = (chunkLen >= params.minSz && hash < params.threshold) || chunkLen >= params.maxSz;
+            }
+            if (!isCut)
+                break;
+
+            BytesCRCUpdate(crc, data + segStart, i - segStart);
+            segStart = i;
+            Chunk chunk = { chunkStart, chunkLen, BytesCRCValue(crc) };
+            chunks.push_back(chunk);
+            chunkStart += chunkLen;
+            chunkLen = 0;
+            hash = 0;
+            crc = emptyCRC;
+        }
+        BytesCRCUpdate(crc, data + segStart, got - segStart);
+        CountProcessed((long long)got);
+        pos += (long long)got;
+    }
+
+    if (chunkLen > 0)
+    {
+        Chunk chunk = { chunkStart, chunkLen, BytesCRCValue(crc) };
+        chunks.push_back(chunk);
+    }
+    return true;
+}
+
+/***************************************************************************
+   Every distinct chunk seen, by fingerprint and length: where it was
+   first seen and how many times. Linear probing in a power of two table
+   that is kept at most half full.
+***************************************************************************/
+
+struct ChunkEntry
+{
+    uint64_t    fp;
+    long long   start;
+    uint32_t    len;
+    uint32_t    file;
+    uint32_t    count;          // 0 for an empty slot
+};
+
+class ChunkTable
+{
+public:
+    ChunkTable() : m_slots(1 << 16), m_used(0)    {}
+
+    // The entry for the chunk, added with a count of 0 if it is new
+    ChunkEntry& Find(uint64_t fp, uint32_t len, uint32_t file, long long start);
+    size_t Size() const                         { return m_used; }
+
+private:
+    size_t Slot(uint64_t fp, uint32_t len) const
+    {
+        return (size_t)((fp ^ ((uint64_t)len * 0x9E3779B97F4A7C15)) & (m_slots.size() - 1));
+    }
+    void Grow();
+
+    std::vector<ChunkEntry> m_slots;
+    size_t                  m_used;
+};
+
+ChunkEntry& ChunkTable::Find(uint64_t fp, uint32_t len, uint32_t file, long long start)
+{
+    size_t s;
+
+    if (2 * (m_used + 1) > m_slots.size())
+        Grow();
+
+    for (s = Slot(fp, len); m_slots[s].count != 0; s = (s + 1) & (m_slots.size() - 1))
+    {
+        if (m_slots[s].fp == fp && m_slots[s].len == len)
+            return m_slots[s];
+    }
+
+    ChunkEntry& entry = m_slots[s];
+    entry.fp = fp;
+    entry.len = len;
+    entry.file = file;
+    entry.start = start;
+    m_used++;
+    return entry;
+}
+
+void ChunkTable::Grow()
+{
+    std::vector<ChunkEntry> old(m_slots.size() * 2);
+
+    old.swap(m_slots);
+    for (size_t o = 0; o < old.size(); o++)
+    {
+        if (old[o].count == 0)
+            continue;
+
+        size_t s = Slot(old[o].fp, old[o].len);
+        while (m_slots[s].count != 0)
+            s = (s + 1) & (m_slots.size() - 1);
+        m_slots[s] = old[o];
+    }
+}
+
+/***************************************************************************
+   Chunk every file named in paths[] (files or directories, walked as for
+   -m) and print the first g_linesToPrint duplicate chunks with where each
+   was first seen, then the totals and how many bytes deduplication would
+   save. Pieces are chunked by g_numThreads workers and their chunks added
+   to the table in file order, so the report is the same for any -j.
+   Returns 0, or -1 if a file could not be read.
+***************************************************************************/
+
+int ReportDuplicateChunks(char** paths, int numPaths, long long avgSz)
+{
+    struct Piece { uint32_t file; long long start, end; bool failed; std::vector<Chunk> chunks; };
+
+    ChunkParams params = MakeChunkParams(avgSz);
+    std::vector<BatchFile> files;
+    std::vector<Piece> pieces;
+    ChunkTable table;
+    long long numChunks = 0, numDuplicates = 0, totalBytes = 0, duplicateBytes = 0, linesPrinted = 0;
+    int retVal = 0;
+    char line[1024];
+    int len;
+
+    for (int i = 0; i < numPaths; i++)
+        CollectBatchFiles(paths[i], true, files);
+
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        for (long long pos = 0; pos < files[f].size; pos += BYTES_THREAD_PIECE_SZ)
+        {
+            Piece piece = { (uint32_t)f, pos, std::min(pos + BYTES_THREAD_PIECE_SZ, files[f].size), false, std::vector<Chunk>() };
+            pieces.push_back(piece);
+        }
+    }
+
+    // Workers chunk pieces in turn; this thread takes them in order. A
+    // worker stays at most a few pieces per thread ahead, to bound memory.
+    std::vector<char> pieceDone(pieces.size(), 0);
+    size_t nextPiece = 0, piecesTaken = 0;
+    size_t window = (size_t)g_numThreads * 4;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> workers;
+    int numThreads = (int)std::min((size_t)g_numThreads, pieces.size());
+
+    for (int t = 0; t < numThreads; t++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            ByteSource src;
+
+            for (;;)
+            {
+                size_t p;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&]() { return nextPiece >= pieces.size() || nextPiece < piecesTaken + window; });
+                    if ((p = nextPiece) >= pieces.size())
+                        return;
+                    nextPiece++;
+                }
+
+                Piece& piece = pieces[p];
+                if (!src.Open(files[piece.file].path.c_str()) ||
+                    !ChunkRange(src, piece.start, piece.end, params, piece.chunks))
+                    piece.failed = true;
+
+                std::lock_guard<std::mutex> guard(lock);
+                pieceDone[p] = 1;
+                changed.notify_all();
+            }
+        }));
+    }
+
+    OutputBuffer out;
+
+    len = snprintf(line, sizeof(line), "  Chunks of %lld to %lld bytes, about %lld on average; duplicates:\n\n",
+                   params.minSz, params.maxSz, params.avgSz);
+    out.Write(line, len);
+
+    for (size_t p = 0; p < pieces.size(); p++)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return pieceDone[p] != 0; });
+        }
+
+        Piece& piece = pieces[p];
+        if (piece.failed)
+        {
+            fprintf(stderr, "  %s: read error\n", files[piece.file].path.c_str());
+            retVal = -1;
+        }
+
+        {
+            PhaseTimer timer(BYTES_PHASE_COMPUTE);
+            for (size_t c = 0; c < piece.chunks.size(); c++)
+            {
+                const Chunk& chunk = piece.chunks[c];
+                ChunkEntry& entry = table.Find(chunk.fp, (uint32_t)chunk.len, piece.file, chunk.start);
+
+                numChunks++;
+                totalBytes += chunk.len;
+                if (entry.count++ == 0)
+                    continue;
+
+                numDuplicates++;
+                duplicateBytes += chunk.len;
+                if (linesPrinted++ < g_linesToPrint)
+                {
+                    len = snprintf(line, sizeof(line), "  char #%lld (%lld bytes) of %s = char #%lld of %s\n",
+                                   chunk.start, chunk.len, files[piece.file].path.c_str(), entry.start,
+                                   files[entry.file].path.c_str());
+                    out.Write(line, len);
+                }
+            }
+        }
+
+        std::vector<Chunk>().swap(piece.chunks);
+        std::lock_guard<std::mutex> guard(lock);
+        piecesTaken = p + 1;
+        changed.notify_all();
+    }
+
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    if (linesPrinted > g_linesToPrint)
+    {
+        len = snprintf(line, sizeof(line), "  ... %lld more\n", linesPrinted - g_linesToPrint);
+        out.Write(line, len);
+    }
+    else if (linesPrinted == 0)
+        out.Write("  none\n", 7);
+
+    len = snprintf(line, sizeof(line),
+                   "\n  %lld files, %lld bytes in %lld chunks (%lld bytes on average)\n"
+                   "  %lld distinct chunks, %lld duplicates\n"
+                   "  Deduplication would save %lld bytes (%.2f%%)\n",
+                   (long long)files.size(), totalBytes, numChunks, numChunks > 0 ? totalBytes / numChunks : 0,
+                   (long long)table.Size(), numDuplicates, duplicateBytes,
+                   totalBytes > 0 ? 100.0 * duplicateBytes / totalBytes : 0.0);
+    out.Write(line, len);
+    return retVal;
+}
+
+/***************************************************************************
+   Follow mode (-f). Dumps a file and then every byte appended to it, in
+   whole rows of the usual layout, until interrupted or until end is
+   reached, keeping a running CRC of what it has shown. On Linux it sleeps
+   on inotify until the file changes; elsewhere it looks at the file every
+   BYTES_FOLLOW_POLL_MS. A file that shrinks is followed again from its
+   start, as is a new file that replaces it under the same name (log
+   rotation).
+***************************************************************************/
+
+static volatile sig_atomic_t g_stopFollowing = 0;
+
+static void StopFollowing(int)
+{
+    g_stopFollowing = 1;
+}
+
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    void Watch(const char* filePath);
+    void Wait(int timeoutMs);
+
+private:
+#ifdef __linux__
+    int     m_fd;
+    int     m_wd;
+#endif
+};
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wd = -1;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (m_fd >= 0)
+        close(m_fd);
+#endif
+}
+
+// Watch filePath, the file now under that name, instead of the last one
+void FileWatcher::Watch(const char* filePath)
+{
+#ifdef __linux__
+    if (m_fd < 0)
+        return;
+    if (m_wd >= 0)
+        inotify_rm_watch(m_fd, m_wd);
+    m_wd = inotify_add_watch(m_fd, filePath, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+#else
+    (void)filePath;
+#endif
+}
+
+// Return once the file may have changed, timeoutMs has passed or a signal
+// arrived
+void FileWatcher::Wait(int timeoutMs)
+{
+#ifdef __linux__
+    if (m_fd >= 0 && m_wd >= 0)
+    {
+        struct pollfd pfd = { m_fd, POLLIN, 0 };
+        char events[4096];
+
+        if (poll(&pfd, 1, timeoutMs) > 0)
+        {
+            while (read(m_fd, events, sizeof(events)) > 0)
+                ;   // Only that something happened matters
+        }
+        return;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+}
+
+// Whether the file now under filePath is not the one open as fd
+static bool IsFileReplaced(const char* filePath, int fd)
+{
+    struct _stat64 pathStat, fdStat;
+
+    if (_stat64(filePath, &pathStat) != 0 || _fstat64(fd, &fdStat) != 0)
+        return false;   // Gone for now; keep the old one until it is back
+    return pathStat.st_ino != fdStat.st_ino || pathStat.st_dev != fdStat.st_dev;
+}
+
+/***************************************************************************
+   Follow the file from char start (or, if start is negative, from the
+   last g_linesToPrint rows) to end. Returns 0, or -1 on error.
+***************************************************************************/
+
+int FollowFile(char* filePath, long long start, long long end)
+{
+    long long width = g_config.numColWidth, pos, crcStart, fileSz;
+    size_t buffSz = (size_t)(BYTES_READ_BUFF_SZ / width > 0 ? BYTES_READ_BUFF_SZ / width * width : width);
+    std::vector<unsigned char> buff(buffSz);
+    size_t pending = 0, off;
+    BytesCRC crc;
+    struct _stat64 statBuff;
+    FileWatcher watcher;
+    char line[160];
+    int fd, len;
+
+    if ((fd = _open(filePath, _O_RDONLY | _O_BINARY)) < 0 || _fstat64(fd, &statBuff) != 0)
+    {
+        HandleFileIOErr(filePath);
+        return -1;
+    }
+    watcher.Watch(filePath);
+
+#ifdef _WIN32
+    signal(SIGINT, StopFollowing);
+#else
+    // Without SA_RESTART, so Ctrl-C also ends a wait in poll()
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = StopFollowing;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+#endif
+
+    // By default show about a page of what is there already, in whole rows
+    if (start < 0)
+    {
+        start = statBuff.st_size - g_linesToPrint * width;
+        start = start < 0 ? 0 : start - start % width;
+    }
+    pos = crcStart = start;
+    BytesCRCStart(crc, g_crcAlgorithm->name);
+
+    OutputBuffer out;
+
+    len = snprintf(line, sizeof(line), "start at char #%lld, following %s\n\n", start, filePath);
+    out.Write(line, len);
+
+    while (!g_stopFollowing && pos < end)
+    {
+        // Start over on a new file under the same name, or on this one if
+        // it was cut short
+        const char* restart = NULL;
+
+        if (IsFileReplaced(filePath, fd))
+        {
+            int newFd = _open(filePath, _O_RDONLY | _O_BINARY);
+            if (newFd >= 0)
+            {
+                _close(fd);
+                fd = newFd;
+                watcher.Watch(filePath);
+                restart = "was replaced";
+            }
+        }
+        if (_fstat64(fd, &statBuff) != 0)
+            break;
+        fileSz = statBuff.st_size;
+        if (restart == NULL && fileSz < pos)
+            restart = "was truncated";
+        if (restart != NULL)
+        {
+            if (pending > 0)
+                out.Commit(BytesFormat(g_config, &buff[0], pending, out.Reserve(BytesFormatSize(g_config, pending)),
+                                       BytesFormatSize(g_config, pending)));
+            len = snprintf(line, sizeof(line), "\n  %s %s; following from char #0\n\n", filePath, restart);
+            out.Write(line, len);
+            pos = crcStart = 0;
+            pending = 0;
+            BytesCRCStart(crc, g_crcAlgorithm->name);
+        }
+
+        long long burstStart = pos;
+        while (pos < fileSz && pos < end && !g_stopFollowing)
+        {
+            long long want = (long long)(buffSz - pending);
+            long long got;
+
+            if (want > fileSz - pos)
+                want = fileSz - pos;
+            if (want > end - pos)
+                want = end - pos;
+            {
+                PhaseTimer timer(BYTES_PHASE_READ);
+                got = PositionalRead(fd, &buff[pending], (size_t)want, pos);
+            }
+            if (got < 0)
+            {
+                HandleFileIOErr(filePath);
+                _close(fd);
+                return -1;
+            }
+            if (got == 0)
+                break;      // Shrunk since the fstat; seen next time round
+            {
+                PhaseTimer timer(BYTES_PHASE_COMPUTE);
+                BytesCRCUpdate(crc, &buff[pending], (size_t)got);
+            }
+            CountProcessed(got);
+            pos += got;
+            pending += (size_t)got;
+
+            // Print the rows that are complete; the rest waits for more
+            PhaseTimer timer(BYTES_PHASE_FORMAT);
+            off = pending / (size_t)width * (size_t)width;
+            out.Commit(BytesFormat(g_config, &buff[0], off, out.Reserve(BytesFormatSize(g_config, off)),
+                                   BytesFormatSize(g_config, off)));
+            memmove(&buff[0], &buff[off], pending - off);
+            pending -= off;
+        }
+
+        if (g_computeCRC && pos > burstStart)
+        {
+            len = snprintf(line, sizeof(line), "  [%s of chars #%lld to #%lld = %llx]\n\n", g_crcAlgorithm->title,
+                           crcStart, pos - 1, (unsigned long long)BytesCRCValue(crc));
+            out.Write(line, len);
+        }
+        out.Flush();
+
+        if (pos < end && !g_stopFollowing)
+            watcher.Wait(BYTES_FOLLOW_POLL_MS);
+    }
+
+    // The last, partial row
+    if (pending > 0)
+        out.Commit(BytesFormat(g_config, &buff[0], pending, out.Reserve(BytesFormatSize(g_config, pending)),
+                               BytesFormatSize(g_config, pending)));
+    len = snprintf(line, sizeof(line), "\n  %s of chars #%lld to #%lld = %llx\n", g_crcAlgorithm->title, crcStart,
+                   pos - 1, (unsigned long long)BytesCRCValue(crc));
+    out.Write(line, len);
+
+    _close(fd);
+    return 0;
+}
+
+/***************************************************************************
+   Block manifests (-M, -V). A manifest is a text file beside the file it
+   describes, named with BYTES_MANIFEST_EXT appended, holding the CRC that
+   was used, the file's size and modification time when it was read, the
+   block size and the CRC of the whole file, then the CRC of every block,
+   one per line. Verifying trusts an unchanged size and modification time
+   and reads nothing; otherwise it reads the file and reports which blocks
+   no longer match.
+***************************************************************************/
+
+struct Manifest
+{
+    const CRCAlgorithm* alg;
+    long long           size;
+    long long           mtime;
+    long long           blockSz;
+    uint64_t            crc;
+    std::vector<uint64_t> blocks;
+};
+
+struct BlockCRC
+{
+    long long   start;
+    uint64_t    crc;
+};
+
+// The modification time in nanoseconds since 1970, or -1. Not the file
+// system clock's own ticks, whose epoch and unit differ between compilers,
+// so a manifest written by one build of bytes matches on any other.
+long long FileModTime(const std::string& path)
+{
+    struct _stat64 statBuff;
+    long long nsec = 0;
+
+    if (_stat64(path.c_str(), &statBuff) != 0)
+        return -1;
+#if defined(__APPLE__)
+    nsec = statBuff.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+    nsec = statBuff.st_mtim.tv_nsec;
+#endif
+    return (long long)statBuff.st_mtime * 1000000000LL + nsec;
+}
+
+static bool IsManifestPath(const std::string& path)
+{
+    size_t extLen = strlen(BYTES_MANIFEST_EXT);
+
+    return path.size() > extLen && path.compare(path.size() - extLen, extLen, BYTES_MANIFEST_EXT) == 0;
+}
+
+/***************************************************************************
+   The CRCs of the blocks of the file that start in [pos, reportEnd); a
+   block may run on to end. Returns end, or -1 on a read error.
+***************************************************************************/
+
+long long BlockCRCRange(const CRCAlgorithm& alg, ByteSource& src, long long pos, long long end, long long reportEnd,
+                        long long blockSz, std::vector<BlockCRC>& blocks)
+{
+    // The first block that starts at or after pos
+    for (pos = (pos + blockSz - 1) / blockSz * blockSz; pos < reportEnd && pos < end; pos += blockSz)
+    {
+        BlockCRC block = { pos, 0 };
+        long long blockEnd = end - pos < blockSz ? end : pos + blockSz;
+        BytesCRC crc;
+
+        BytesCRCStart(crc, alg.name);
+        if (!UpdateCRCRange(src, pos, blockEnd, crc))
+            return -1;
+        block.crc = BytesCRCValue(crc);
+        blocks.push_back(block);
+    }
+    return end;
+}
+
+/***************************************************************************
+   Append to crcs the CRCs alg of the blocks of bytes [0, end) of the
+   file, with g_numThreads workers. Returns false on error.
+***************************************************************************/
+
+bool ComputeBlockCRCs(const CRCAlgorithm& alg, const std::string& path, long long end, long long blockSz,
+                      std::vector<uint64_t>& crcs)
+{
+    char* filePath = const_cast<char*>(path.c_str());
+    long long numBlocks;
+
+    numBlocks = ScanInPieces<BlockCRC>(&filePath, 1, 0, end, blockSz - 1,
+        [&](ByteSource* src, long long pos, long long scanEnd, long long reportEnd, std::vector<BlockCRC>& blocks)
+        {
+            return BlockCRCRange(alg, src[0], pos, scanEnd, reportEnd, blockSz, blocks);
+        },
+        [&](const std::vector<BlockCRC>& blocks)
+        {
+            for (size_t b = 0; b < blocks.size(); b++)
+                crcs.push_back(blocks[b].crc);
+        });
+    return numBlocks >= 0;
+}
+
+bool ReadManifest(const std::string& path, Manifest& manifest)
+{
+    char name[32];
+    unsigned long long crc;
+    long long numBlocks;
+    bool isValid = false;
+    FILE* file;
+
+    if ((file = fopen(path.c_str(), "r")) == NULL)
+        return false;
+
+    if (fscanf(file, "bytes manifest 1\ncrc %31s\nsize %lld\nmtime %lld\nblock %lld\nfile %llx\nblocks %lld\n",
+               name, &manifest.size, &manifest.mtime, &manifest.blockSz, &crc, &numBlocks) == 6 &&
+        manifest.blockSz > 0 && numBlocks == (manifest.size + manifest.blockSz - 1) / manifest.blockSz)
+    {
+        manifest.alg = FindCRCAlgorithm(name);
+        manifest.crc = crc;
+        manifest.blocks.clear();
+        while ((long long)manifest.blocks.size() < numBlocks && fscanf(file, "%llx", &crc) == 1)
+            manifest.blocks.push_back(crc);
+        isValid = manifest.alg != NULL && (long long)manifest.blocks.size() == numBlocks;
+    }
+
+    fclose(file);
+    return isValid;
+}
+
+// Write to a temporary file and rename it over the old manifest, so an
+// interrupted run never leaves a truncated one behind.
+bool WriteManifest(const std::string& path, const Manifest& manifest)
+{
+    std::string tmpPath = path + ".tmp";
+    int digits = manifest.alg->width / 4;
+    std::error_code ec;
+    FILE* file;
+    bool isWritten;
+
+    if ((file = fopen(tmpPath.c_str(), "w")) == NULL)
+        return false;
+
+    fprintf(file, "bytes manifest 1\ncrc %s\nsize %lld\nmtime %lld\nblock %lld\nfile %0*llx\nblocks %lld\n",
+            manifest.alg->name, manifest.size, manifest.mtime, manifest.blockSz, digits,
+            (unsigned long long)manifest.crc, (long long)manifest.blocks.size());
+    for (size_t b = 0; b < manifest.blocks.size(); b++)
+        fprintf(file, "%0*llx\n", digits, (unsigned long long)manifest.blocks[b]);
+
+    isWritten = !ferror(file);
+    if (fclose(file) != 0)
+        isWritten = false;
+    if (isWritten)
+        std::filesystem::rename(tmpPath, path, ec);
+    if (!isWritten || ec)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+// The CRC of the whole file from the CRCs of its blocks
+uint64_t CombineBlockCRCs(const CRCAlgorithm& alg, const std::vector<uint64_t>& blocks, long long size, long long blockSz)
+{
+    BytesCRC crc;
+
+    BytesCRCStart(crc, alg.name);
+    uint64_t crcVal = BytesCRCValue(crc);
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        long long len = size - (long long)b * blockSz < blockSz ? size - (long long)b * blockSz : blockSz;
+        crcVal = BytesCRCCombine(crc, crcVal, blocks[b], len);
+    }
+    return crcVal;
+}
+
+/***************************************************************************
+   Write a manifest of blockSz byte blocks for every file named in paths[]
+   (files or directories, walked as for -m). Returns 0, or -1 if any file
+   could not be read or its manifest written.
+***************************************************************************/
+
+int WriteManifests(char** paths, int numPaths, long long blockSz)
+{
+    std::vector<BatchFile> files;
+    int retVal = 0;
+
+    for (int i = 0; i < numPaths; i++)
+        CollectBatchFiles(paths[i], true, files);
+
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        Manifest manifest;
+
+        if (IsManifestPath(files[f].path))
+            continue;
+
+        // Taken before reading, so a change made meanwhile shows up later
+        manifest.alg = g_crcAlgorithm;
+        manifest.size = files[f].size;
+        manifest.mtime = FileModTime(files[f].path);
+        manifest.blockSz = blockSz;
+
+        if (!ComputeBlockCRCs(*manifest.alg, files[f].path, manifest.size, blockSz, manifest.blocks))
+        {
+            retVal = -1;
+            continue;
+        }
+        manifest.crc = CombineBlockCRCs(*manifest.alg, manifest.blocks, manifest.size, blockSz);
+
+        if (!WriteManifest(files[f].path + BYTES_MANIFEST_EXT, manifest))
+        {
+            fprintf(stderr, "  %s%s: could not be written\n", files[f].path.c_str(), BYTES_MANIFEST_EXT);
+            retVal = -1;
+            continue;
+        }
+        printf("%0*llx  %s  (%lld blocks)\n", manifest.alg->width / 4, (unsigned long long)manifest.crc,
+               files[f].path.c_str(), (long long)manifest.blocks.size());
+    }
+
+    return retVal;
+}
+
+/***************************************************************************
+   Check every file named in paths[] against its manifest. Files whose
+   size and modification time are unchanged are reported as such without
+   being read. For the others, the blocks the manifest covers are
+   recomputed over the lengths they had then, each run of blocks that
+   differs is printed as a byte range, and bytes past the old end are
+   reported as appended. Returns 0 if every file matches, 1 if any changed or has no
+   manifest, -1 on a read error.
+***************************************************************************/
+
+int VerifyManifests(char** paths, int numPaths)
+{
+    std::vector<BatchFile> files;
+    long long numSkipped = 0, numMatched = 0, numChanged = 0, numMissing = 0;
+    int retVal = 0;
+
+    for (int i = 0; i < numPaths; i++)
+        CollectBatchFiles(paths[i], true, files);
+
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        const std::string& path = files[f].path;
+        Manifest manifest;
+        std::vector<uint64_t> crcs;
+        long long size = files[f].size, blockSz, end;
+        bool isChanged;
+
+        if (IsManifestPath(path))
+            continue;
+
+        if (!ReadManifest(path + BYTES_MANIFEST_EXT, manifest))
+        {
+            printf("  no manifest  %s\n", path.c_str());
+            numMissing++;
+            retVal = retVal < 0 ? retVal : 1;
+            continue;
+        }
+
+        if (size == manifest.size && FileModTime(path) == manifest.mtime)
+        {
+            printf("  unchanged    %s\n", path.c_str());
+            numSkipped++;
+            continue;
+        }
+
+        // Only the bytes the manifest has CRCs for are worth reading, and
+        // the last block is compared over the length it had then
+        blockSz = manifest.blockSz;
+        end = size < manifest.size ? size : manifest.size;
+        if (!ComputeBlockCRCs(*manifest.alg, path, end, blockSz, crcs))
+        {
+            retVal = -1;
+            continue;
+        }
+
+        // Runs of blocks that no longer match, as byte ranges
+        std::vector<DiffRange> ranges;
+        for (long long b = 0; b < (long long)crcs.size(); b++)
+        {
+            if (crcs[(size_t)b] == manifest.blocks[(size_t)b])
+                continue;
+            if (!ranges.empty() && ranges.back().end == b * blockSz)
+                ranges.back().end = (b + 1) * blockSz;
+            else
+            {
+                DiffRange range = { b * blockSz, (b + 1) * blockSz };
+                ranges.push_back(range);
+            }
+        }
+
+        isChanged = !ranges.empty() || size != manifest.size;
+        if (isChanged)
+            printf("  changed      %s\n", path.c_str());
+        for (size_t r = 0; r < ranges.size(); r++)
+        {
+            long long rangeEnd = ranges[r].end < end ? ranges[r].end : end;
+            printf("    differ at char #%lld to #%lld (blocks %lld to %lld)\n", ranges[r].start, rangeEnd - 1,
+                   ranges[r].start / blockSz, ranges[r].end / blockSz - 1);
+        }
+        if (size > manifest.size)
+            printf("    appended chars #%lld to #%lld\n", manifest.size, size - 1);
+        else if (size < manifest.size)
+            printf("    size was %lld, is %lld\n", manifest.size, size);
+
+        if (isChanged)
+        {
+            numChanged++;
+            retVal = retVal < 0 ? retVal : 1;
+        }
+        else
+        {
+            printf("  verified     %s\n", path.c_str());
+            numMatched++;
+        }
+    }
+
+    printf("\n  %lld unchanged, %lld verified, %lld changed, %lld without a manifest\n",
+           numSkipped, numMatched, numChanged, numMissing);
+    return retVal;
+}
+
+/***************************************************************************
+Get the width, in characters, of the console window in which this program
+is running.
+***************************************************************************/
+int GetConsoleWidth()
+{
+#ifdef _WIN32
+
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    int columns, rows, retCols;
+
+    GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
+    columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+    rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+
+    retCols = (columns - 1) / 4;
+    return ((retCols) < 5 ? 40 : retCols);
+#else
+
+    struct winsize ws;
+    int retCols;
+
+    // Not a terminal (e.g. output piped to a file): keep the old default
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0)
+        return 20;
+
+    retCols = (ws.ws_col - 1) / 4;
+    return ((retCols) < 5 ? 40 : retCols);
+#endif
+}
+
+/***************************************************************************
+Get the height, in lines, of the console window in which this program is
+running.
+***************************************************************************/
+int GetConsoleHeight()
+{
+#ifdef _WIN32
+
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
+        return 24;
+    return csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+#else
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_row == 0)
+        return 24;
+    return ws.ws_row;
+#endif
+}
+
+/***************************************************************************
+   Interactive pager (-i). Only the rows on the screen are read and
+   formatted, straight from the mapped file, so a file of any size opens
+   at once and moving to any offset costs one screen. The screen is drawn
+   with ANSI escape sequences; keys are read one at a time, with echo off.
+***************************************************************************/
+
+#define BYTES_KEY_UP            0x101
+#define BYTES_KEY_DOWN          0x102
+#define BYTES_KEY_PAGE_UP       0x103
+#define BYTES_KEY_PAGE_DOWN     0x104
+#define BYTES_KEY_HOME          0x105
+#define BYTES_KEY_END           0x106
+#define BYTES_KEY_ESCAPE        0x1B
+
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
+class Terminal
+{
+public:
+    Terminal();
+    ~Terminal();
+
+    bool IsOpen() const         { return m_isOpen; }
+    int ReadKey();
+    bool ReadLine(const char* prompt, int line, std::string& text);
+
+private:
+    bool            m_isOpen;
+#ifdef _WIN32
+    DWORD           m_inMode;
+    DWORD           m_outMode;
+#else
+    struct termios  m_saved;
+#endif
+};
+
+// Keys one at a time without echo, and Ctrl-C as a key rather than a
+// signal, on the alternate screen so the shell's screen comes back after
+Terminal::Terminal()
+{
+#ifdef _WIN32
+    HANDLE in = GetStdHandle(STD_INPUT_HANDLE), out = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    m_isOpen = GetConsoleMode(in, &m_inMode) && GetConsoleMode(out, &m_outMode) &&
+               SetConsoleMode(out, m_outMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    if (!m_isOpen)
+        return;
+    SetConsoleMode(in, m_inMode & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_PROCESSED_INPUT));
+#else
+    struct termios raw;
+
+    m_isOpen = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && tcgetattr(STDIN_FILENO, &m_saved) == 0;
+    if (!m_isOpen)
+        return;
+    raw = m_saved;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+#endif
+    printf("\x1b[?1049h\x1b[?25l");
+    fflush(stdout);
+}
+
+Terminal::~Terminal()
+{
+    if (!m_isOpen)
+        return;
+    printf("\x1b[?25h\x1b[?1049l");
+    fflush(stdout);
+#ifdef _WIN32
+    SetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), m_inMode);
+    SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), m_outMode);
+#else
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &m_saved);
+#endif
+}
+
+// A character, or one of the BYTES_KEY_ values for the keys that send
+// sequences; -1 when input ends
+int Terminal::ReadKey()
+{
+#ifdef _WIN32
+    int c = _getch();
+
+    if (c == 0 || c == 0xE0)
+    {
+        switch (_getch())
+        {
+            case 72:    return BYTES_KEY_UP;
+            case 80:    return BYTES_KEY_DOWN;
+            case 73:    return BYTES_KEY_PAGE_UP;
+            case 81:    return BYTES_KEY_PAGE_DOWN;
+            case 71:    return BYTES_KEY_HOME;
+            case 79:    return BYTES_KEY_END;
+            default:    return 0;
+        }
+    }
+    return c;
+#else
+    unsigned char c, seq[3];
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+
+    if (read(STDIN_FILENO, &c, 1) != 1)
+        return -1;
+    if (c != BYTES_KEY_ESCAPE)
+        return c;
+
+    // A lone Escape, or the start of ESC [ x, ESC [ n ~ or ESC O x
+    if (poll(&pfd, 1, 50) <= 0 || read(STDIN_FILENO, &seq[0], 1) != 1)
+        return BYTES_KEY_ESCAPE;
+    if ((seq[0] != '[' && seq[0] != 'O') || read(STDIN_FILENO, &seq[1], 1) != 1)
+        return 0;
+    if (seq[1] >= '0' && seq[1] <= '9')
+    {
+        if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~')
+            return 0;
+        switch (seq[1])
+        {
+            case '1': case '7':     return BYTES_KEY_HOME;
+            case '4': case '8':     return BYTES_KEY_END;
+            case '5':               return BYTES_KEY_PAGE_UP;
+            case '6':               return BYTES_KEY_PAGE_DOWN;
+            default:                return 0;
+        }
+    }
+    switch (seq[1])
+    {
+        case 'A':   return BYTES_KEY_UP;
+        case 'B':   return BYTES_KEY_DOWN;
+        case 'H':   return BYTES_KEY_HOME;
+        case 'F':   return BYTES_KEY_END;
+        default:    return 0;
+    }
+#endif
+}
+
+// Read a line of text typed after prompt on screen line line. Returns
+// false if it was cancelled with Escape.
+bool Terminal::ReadLine(const char* prompt, int line, std::string& text)
+{
+    int key;
+
+    text.clear();
+    for (;;)
+    {
+        printf("\x1b[%d;1H\x1b[2K%s%s\x1b[?25h", line, prompt, text.c_str());
+        fflush(stdout);
+        key = ReadKey();
+        printf("\x1b[?25l");
+        if (key == '\r' || key == '\n')
+            return true;
+        if (key < 0 || key == BYTES_KEY_ESCAPE || key == 3)
+            return false;
+        if ((key == 8 || key == 127) && !text.empty())
+            text.erase(text.size() - 1);
+        else if (key >= 32 && key < 127)
+            text += (char)key;
+    }
+}
+
+// The first match of g_searchPattern at or after from, or -1. Unless the
+// pattern is all zeros it cannot lie wholly in a hole, so only the data
+// extents of a sparse file, and the pattern's length before each, are read.
+long long FindNextMatch(ByteSource& src, long long from, long long size)
+{
+    long long overlap = (long long)g_searchPattern.size() - 1;
+    bool skipHoles = std::find_if(g_searchPattern.begin(), g_searchPattern.end(),
+                                  [](unsigned char c) { return c != 0; }) != g_searchPattern.end();
+    std::vector<long long> hits;
+    long long pos = from, dataStart, dataEnd = size;
+
+    while (pos < size)
+    {
+        if (skipHoles)
+        {
+            if ((dataStart = src.NextData(pos, &dataEnd)) >= size)
+                break;
+            if (dataStart - overlap > pos)
+                pos = dataStart - overlap;
+        }
+
+        for (; pos < dataEnd; pos += BYTES_THREAD_PIECE_SZ)
+        {
+            long long pieceEnd = dataEnd - pos > BYTES_THREAD_PIECE_SZ ? pos + BYTES_THREAD_PIECE_SZ : dataEnd;
+            long long scanEnd = size - pieceEnd > overlap ? pieceEnd + overlap : size;
+
+            if (SearchRange(src, pos, scanEnd, pieceEnd, hits) < 0)
+                throw Exception("Error reading file!");
+            if (!hits.empty())
+                return hits[0];
+        }
+        pos = dataEnd;
+    }
+    return -1;
+}
+
+/***************************************************************************
+   Page through the file: arrows move a row, PgUp/PgDn (or b/space) a
+   screen, Home/End (or g/G) to either end, ':' jumps to a char #, '/'
+   finds text, '\' finds hex bytes, 'n' finds the next match, 'q' quits.
+   Returns 0, or -1 on error.
+***************************************************************************/
+
+int PageFile(char* filePath)
+{
+    long long width = g_config.numColWidth, size, top = 0, lastTop, match = -1;
+    int screenCols, screenLines, rows, key, len;
+    long long next;
+    const unsigned char* data = NULL;
+    std::string input, message;
+    char line[512], status[600];
+    ByteSource src;
+
+    if (!src.Open(filePath))
+    {
+        HandleFileIOErr(filePath);
+        return -1;
+    }
+    if (src.IsStream())
+        throw Exception("\n  -i needs a file it can seek in, not a stream\n");
+    size = src.Size();
+
+    Terminal term;
+    if (!term.IsOpen())
+        throw Exception("\n  -i needs a terminal\n");
+
+    for (;;)
+    {
+        // Every dump row takes three lines; the last line is the status
+        screenCols = GetConsoleWidth() * 4 + 1;
+        screenLines = GetConsoleHeight();
+        rows = (screenLines - 1) / 3 > 0 ? (screenLines - 1) / 3 : 1;
+
+        lastTop = size > 0 ? ((size - 1) / width - rows + 1) * width : 0;
+        if (top > lastTop)
+            top = lastTop;
+        if (top < 0)
+            top = 0;
+
+        {
+            OutputBuffer out;
+            long long want = size - top < rows * width ? size - top : rows * width;
+            size_t got = 0;
+
+            out.Write("\x1b[H\x1b[2J", 7);
+            if (want > 0 && src.Seek(top) && (got = src.Next(&data, (size_t)want)) < (size_t)want)
+                throw Exception("Error reading file!");
+            DumpRows(data, got, rows, out);
+
+            len = snprintf(line, sizeof(line), " char #%lld to #%lld of %lld (%d%%)  %s  q quit, : char #, / text, \\ hex, n next",
+                           top, top + (long long)got - 1, size, size > 0 ? (int)(100.0 * (top + (long long)got) / size) : 100,
+                           message.c_str());
+            if (len > (int)sizeof(line) - 1)
+                len = (int)sizeof(line) - 1;
+            if (len > screenCols - 1)
+                len = screenCols - 1;
+            len = snprintf(status, sizeof(status), "\x1b[%d;1H\x1b[7m%.*s\x1b[0m", screenLines, len, line);
+            out.Write(status, (size_t)len);
+        }
+        message.clear();
+
+        switch (key = term.ReadKey())
+        {
+            case BYTES_KEY_UP:
+            case 'k':
+                top -= width;
+                break;
+            case BYTES_KEY_DOWN:
+            case 'j':
+            case '\r':
+            case '\n':
+                top += width;
+                break;
+            case BYTES_KEY_PAGE_UP:
+            case 'b':
+                top -= rows * width;
+                break;
+            case BYTES_KEY_PAGE_DOWN:
+            case ' ':
+            case 'f':
+                top += rows * width;
+                break;
+            case BYTES_KEY_HOME:
+            case 'g':
+                top = 0;
+                break;
+            case BYTES_KEY_END:
+            case 'G':
+                top = lastTop;
+                break;
+            case ':':
+                if (term.ReadLine("char #: ", screenLines, input) && !input.empty())
+                {
+                    long long pos = ParseSize(input.c_str()) - 1;
+                    if (pos < 0 || pos >= size)
+                        message = "no such char #";
+                    else
+                        top = pos - pos % width;
+                }
+                break;
+            case '/':
+            case '\\':
+                if (!term.ReadLine(key == '/' ? "text: " : "hex: ", screenLines, input) || input.empty())
+                    break;
+                if (key == '/')
+                    g_searchPattern.assign(input.begin(), input.end());
+                else if (!ParseHexPattern(input.c_str(), g_searchPattern) || g_searchPattern.empty())
+                {
+                    g_searchPattern.clear();
+                    message = "hex needs pairs of digits";
+                    break;
+                }
+                match = top - 1;
+                [[fallthrough]];
+            case 'n':
+                if (g_searchPattern.empty())
+                    break;
+                if ((next = FindNextMatch(src, match + 1, size)) < 0)
+                    message = "not found";
+                else
+                {
+                    match = next;
+                    top = match - match % width;
+                    snprintf(line, sizeof(line), "match at char #%lld", match);
+                    message = line;
+                }
+                break;
+            case 'q':
+            case 3:
+            case BYTES_KEY_ESCAPE:
+            case -1:
+                return 0;
+        }
+    }
+}
+
+/***************************************************************************
+   MAIN
+
+   Builds that supply their own main(), such as bytes_bench.cpp which
+   includes this file, define BYTES_NO_MAIN.
+***************************************************************************/
+
+#ifndef BYTES_NO_MAIN
+
+int main(int argc, char *argv[])
+{
+    int retVal = 0;
+    long long start = 0, end = 0, fileSz, sizeLimit;
+    unsigned int defNumToShow;
+    uint64_t crc;
+    int fileRet = 0;
+    struct _stat64 statBuff;
+    errno = 0;
+    ByteSource inFile;
+
+    try
+    {
+        g_runStartTime = std::chrono::steady_clock::now();
+        g_config.numColWidth = GetConsoleWidth();
+        g_endianness = DetectEndianness();
+        BytesInit();
+
+        argc = deal_with_options(argc, argv);
+
+        // Manifests are written or verified for any number of files and
+        // directories
+        if ((g_manifestBlockSz != 0 || g_verifyManifests) && argc >= 2)
+        {
+            SelectCRC32Kernel(g_crcKernelName);
+            SelectCRCAlgorithm(g_crcAlgorithmName);
+            if (g_verifyManifests)
+                return VerifyManifests(argv + 1, argc - 1);
+            return WriteManifests(argv + 1, argc - 1, g_manifestBlockSz);
+        }
+
+        // So does the duplicate chunk report
+        if (g_chunkAvgSz != 0 && argc >= 2)
+            return ReportDuplicateChunks(argv + 1, argc - 1, g_chunkAvgSz);
+
+        // Batch mode takes any number of files and directories
+        if (g_batchCRC && argc >= 2)
+        {
+            SelectCRC32Kernel(g_crcKernelName);
+            SelectCRCAlgorithm(g_crcAlgorithmName);
+            return ComputeBatchCRCs(argv + 1, argc - 1);
+        }
+
+        // Compare mode takes two files, then start and end
+        if (g_compareFiles && argc >= 3 && argc <= 5)
+        {
+            start = argc >= 4 ? strtoll(argv[3], NULL, 0) - 1 : 0;
+            if (start < 1)
+                start = 0;
+            end = argc == 5 ? strtoll(argv[4], NULL, 0) : LLONG_MAX;
+            if (end < 1)
+                end = LLONG_MAX;
+            return CompareFiles(argv + 1, start, end);
+        }
+
+        if(argc != 2 && argc != 3 && argc != 4)
+        {
+            if (!g_reportEndianness && !g_computeCRC)
+                PrintUsage(); // Don't need to print usage in these cases
+            throw Exception();
+        }
+
+        // "-" reads stdin, whose size is not known up front (-1). Anything
+        // that is not a regular file is streamed the same way.
+        if (strcmp(argv[1], "-") == 0)
+            fileSz = -1;
+        else if (_stat64(argv[1], &statBuff) != 0)
+        {
+            HandleFileIOErr(argv[1]);
+            throw Exception();
+        }
+        else
+            fileSz = (statBuff.st_mode & S_IFMT) == S_IFREG ? statBuff.st_size : -1;
+
+        // Until the end of a stream is reached it is as large as it gets
+        sizeLimit = fileSz < 0 ? LLONG_MAX : fileSz;
+
+        if (g_interactive)
+            return PageFile(argv[1]);
+
+        // Ranges from -r and -R take the place of start and end
+        if (g_rangeList != NULL || g_rangeFile != NULL)
+            return DumpRanges(argv[1], g_rangeList, g_rangeFile);
+
+        // Follow mode starts near the end unless told otherwise, and has no
+        // end unless one is given
+        if (g_followFile)
+        {
+            if (fileSz < 0)
+                throw Exception("\n  -f follows regular files only\n");
+            SelectCRC32Kernel(g_crcKernelName);
+            SelectCRCAlgorithm(g_crcAlgorithmName);
+            start = argc >= 3 ? strtoll(argv[2], NULL, 0) - 1 : -1;
+            if (argc >= 3 && start < 1)
+                start = 0;
+            end = argc == 4 ? strtoll(argv[3], NULL, 0) : LLONG_MAX;
+            if (end < 1)
+                end = LLONG_MAX;
+            return FollowFile(argv[1], start, end);
+        }
+
+        if (g_computeCRC)
+        {
+            SelectCRC32Kernel(g_crcKernelName);
+            SelectCRCAlgorithm(g_crcAlgorithmName);
+            if (g_crcKernelName != NULL)
+                printf("\n  CRC kernel: %s", g_crcKernelName);
+            crc = ComputeCRC(argv[1], fileSz);
+            printf("\n  %s = %llx\n", g_crcAlgorithm->title, (unsigned long long)crc);
+        }
+
+        if (g_computeCRC && argc < 3 && g_searchArg == NULL && !g_scanSignatures && g_profileBlockSz == 0)
+            throw Exception(); // No error, just finished
+
+        // A search or scan covers the whole input unless start and end are given
+        if (g_searchArg != NULL || g_scanSignatures || g_profileBlockSz != 0)
+        {
+            start = argc >= 3 ? strtoll(argv[2], NULL, 0) - 1 : 0;
+            if (start < 1 || start >= sizeLimit)
+                start = 0;
+            end = argc == 4 ? strtoll(argv[3], NULL, 0) : sizeLimit;
+            if (end < 1 || end > sizeLimit)
+                end = sizeLimit;
+        }
+
+        if (g_scanSignatures)
+            return ScanSignatures(argv[1], start, end, g_signatureFile);
+
+        if (g_profileBlockSz != 0)
+            return ProfileFile(argv[1], start, end, g_profileBlockSz);
+
+        if (g_searchArg != NULL)
+        {
+            if (!g_searchArgIsHex)
+                g_searchPattern.assign(g_searchArg, g_searchArg + strlen(g_searchArg));
+            else if (!ParseHexPattern(g_searchArg, g_searchPattern))
+                throw Exception("\n  -s needs pairs of hex digits (e.g. -sDEADBEEF or -s\"de ad be ef\")\n");
+            if (g_searchPattern.empty() || g_searchPattern.size() > BYTES_SEARCH_MAX_LEN)
+                throw Exception("\n  The search pattern must be 1 to 65536 bytes long\n");
+
+            return SearchFile(argv[1], fileSz, start, end);
+        }
+
+        // By default, if no start and/or end byte numbers are given on the command line,
+        // show about a page of bytes.
+        start = 0;
+        end = (defNumToShow = BYTES_DEF_NUM_COLS * BYTES_DEF_NUM_LINES) < sizeLimit ? defNumToShow : sizeLimit;
+
+        if(argc >= 3)
+        {
             start = strtoll(argv[2], NULL, 0) - 1;     /* char # to start reading. */
-            end = start + defNumToShow;  /* set default end in case not given on cmd line */
-            if(start < 1 || start >= fileSz)
+            if(start < 1 || start >= sizeLimit)
                 start = 0;
+            end = start + defNumToShow;  /* set default end in case not given on cmd line */
+            if(end > sizeLimit)
+                end = sizeLimit;
         }
 
         if(argc == 4)
         {
             end = strtoll(argv[3], NULL, 0);           /* char # to stop reading. */
-            if(end < 1 || end > fileSz)
-                end = fileSz;
+            if(end < 1 || end > sizeLimit)
+                end = sizeLimit;
 
             // Do not limit the number of lines to be printed
             g_linesToPrint = INT_MAX;
         }
-        printf("start at char #%d, end at char #%d\n", start, end);
+        if (end == LLONG_MAX)
+            printf("start at char #%lld, end at end of input\n", start);
+        else
+            printf("start at char #%lld, end at char #%lld\n", start, end);
 
         if (end <= start)
         {
@@ -508,67 +5417,21 @@ int main(int argc, char *argv[])
         }
 
         // Open the file 
-        inFile.open(argv[1], ios::in | ios::binary);
-        if(!inFile)
+        if(!inFile.Open(argv[1]))
         {
             printf("\nError opening %s! (err: %d). Does it exist (in this directory)?\n", argv[1], fileRet);
-            inFile.clear();
             return 1;
         }
 
         /****************************************************************************
-        The following code block prints the output across the screen horizontally.
-        For Intel machines I had to copy the character into an int variable to
-        get it to print out as a number, in the second for loop.  This forced me
-        to define some variables to distinguish between little and big endian char
-        orders. (I'm only copying one char into a 4 byte integer.)
+        The following code block prints the output across the screen horizontally,
+        a row of characters above a row of their numeric values.
         ****************************************************************************/
 
-        fl_pos          = start;
-        linesPrinted    = 0;
-        buff            = (char*)malloc(g_numColWidth);
-
         printf("\n");
-
-        // If not starting at the beginning of the file, set the file read cursor to the start byte
-        if (start != 0)
-            inFile.seekg(start);
-
-        while(fl_pos < end)
         {
-            chunkSz = end - fl_pos < g_numColWidth ? end - fl_pos : g_numColWidth;
-            fl_pos += chunkSz;
-
-            // Read chunkSz number of bytes from file
-            inFile.read(buff, chunkSz);
-            if (inFile.fail())
-                throw new Exception("Error reading file!");
-
-            for(j = 0; j < chunkSz; j++)
-            {
-                uchr = (buff[j] < 0 || !isprint(buff[j])) ? 32 : buff[j];
-                printf("%4.1c", (char)uchr);
-            }
-
-            printf("\n");
-            for(j = 0; j < chunkSz; j++)
-            {
-                tmp = 0;
-    //                wmemset(&tmp,0,sizeof(tmp));
-                if(g_endianness == BYTES_LITTLE_ENDIAN)
-                    memcpy(&tmp,&buff[j],1);
-                else
-                    memcpy((char*)(&tmp) + 3,buff,1);
-
-                if (g_numberFormat == BYTES_HEX_FORMAT)
-                    printf("%4.1X", tmp);
-                else
-                    printf("%4.1u", tmp);
-            }
-            printf("\n\n");
-
-            if (++linesPrinted >= g_linesToPrint)
-                break; // Already printed requested number of lines so exit
+            OutputBuffer out;
+            DumpRange(inFile, start, end, g_linesToPrint, out);
         }
 
         /****************************************************************************
@@ -589,11 +5452,13 @@ int main(int argc, char *argv[])
         retVal = -1;
     }
 
-    inFile.close();
+    inFile.Close();
 
     return retVal;
 }
 
+#endif // BYTES_NO_MAIN
+
 void HandleFileIOErr(char* filePath)
 {
     char buff[1024];
@@ -0,0 +1,358 @@
+/****************************************************************************
+// bytes_bench -- throughput benchmarks for the bytes utility
+//
+// Copyright (c) 1995 - 018 Gerhard W. Gross.
+//
+// Distributed under the same terms as bytes.cpp; see the notice there.
+//
+// Builds bytes.cpp without its main(), linked with libbytes.cpp, and times
+// its hot paths on synthetic data: every CRC-32 kernel, every CRC
+// selectable with -a, every search kernel, the byte histogram, ComputeCRC()
+// on a file (single and multi threaded), and the dump formatter for every
+// cell kernel, -x and -w setting. Each measurement is printed as one JSON
+// object per line so runs can be collected and compared between releases.
+//
+// Usage:  bytes_bench [-g] [-tSECONDS] [-dDIR]
+//
+//  -g also run the multi-GB file sizes (needs the disk space in DIR)
+//  -tSECONDS minimum time to repeat each measurement for (default 0.5)
+//  -dDIR directory for the temporary input file (default current dir)
+//
+****************************************************************************/
+
+#define BYTES_NO_MAIN
+#include "bytes.cpp"
+
+#include <chrono>
+#include <string>
+
+#ifdef _WIN32
+#define BYTES_NULL_DEVICE   "NUL"
+#else
+#define BYTES_NULL_DEVICE   "/dev/null"
+#endif
+
+static double g_minSeconds = 0.5;
+
+/* Input sizes: one that stays in cache, one well past any last level cache,
+   and (with -g) one of several GB that has to come from the disk. */
+static const long long g_cacheSz    = 64LL * 1024;
+static const long long g_memorySz   = 256LL * 1024 * 1024;
+static const long long g_largeSz    = 4LL * 1024 * 1024 * 1024;
+
+/***************************************************************************
+   Fill buff with reproducible pseudo random bytes (xorshift64).
+***************************************************************************/
+
+void FillSynthetic(unsigned char* buff, size_t len, uint64_t seed)
+{
+    uint64_t x = seed | 1;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buff[i] = (unsigned char)(x >> 24);
+    }
+}
+
+/***************************************************************************
+   Run func until at least g_minSeconds have passed, and at least once.
+   Returns the elapsed seconds; *runs gets the number of calls.
+***************************************************************************/
+
+template <typename Func>
+double TimeRuns(Func func, long long* runs)
+{
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    double elapsed;
+
+    *runs = 0;
+    do
+    {
+        func();
+        ++*runs;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    while (elapsed < g_minSeconds);
+
+    return elapsed;
+}
+
+void Report(const char* bench, const char* variant, long long size, int threads,
+            const char* format, int width, long long bytes, double seconds)
+{
+    printf("{\"bench\":\"%s\",\"variant\":\"%s\",\"size\":%lld,\"threads\":%d,"
+           "\"format\":\"%s\",\"width\":%d,\"bytes\":%lld,\"seconds\":%.6f,\"mb_per_s\":%.1f}\n",
+           bench, variant, size, threads, format, width, bytes, seconds,
+           seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+    fflush(stdout);
+}
+
+/***************************************************************************
+   CRC-32 kernels on data already in memory.
+***************************************************************************/
+
+void BenchCRCKernels(const unsigned char* data, long long size)
+{
+    for (int k = 0; k < g_numCrc32Kernels; k++)
+    {
+        const CRC32KernelInfo& kernel = g_crc32Kernels[k];
+        volatile uint32_t sink = 0;
+        long long runs;
+
+        if (kernel.available != NULL && !*kernel.available)
+            continue;
+
+        double seconds = TimeRuns([&]() { sink = kernel.func(0xffffffff, data, (size_t)size); }, &runs);
+        Report("crc32_kernel", kernel.name, size, 1, "", 0, runs * size, seconds);
+    }
+}
+
+/***************************************************************************
+   Every CRC of -a through CRCUpdate(), as the CLI runs it.
+***************************************************************************/
+
+void BenchCRCAlgorithms(const unsigned char* data, long long size)
+{
+    for (int a = 0; a < g_numCrcAlgorithms; a++)
+    {
+        const CRCAlgorithm& alg = g_crcAlgorithms[a];
+        volatile uint64_t sink = 0;
+        long long runs;
+
+        double seconds = TimeRuns([&]() { sink = CRCUpdate(alg, CRCInit(alg), data, (size_t)size); }, &runs);
+        Report("crc_algorithm", alg.name, size, 1, "", 0, runs * size, seconds);
+    }
+}
+
+/***************************************************************************
+   Search kernels on data already in memory, for patterns that do not
+   occur, so every byte is scanned. Horspool is timed on the long ones.
+***************************************************************************/
+
+void BenchSearchKernels(const unsigned char* data, long long size)
+{
+    static const size_t lengths[] = { 4, 16, BYTES_HORSPOOL_MIN_LEN, 1024 };
+    std::vector<unsigned char> pattern(1024);
+    std::vector<long long> hits;
+    long long runs;
+
+    FillSynthetic(&pattern[0], pattern.size(), 12345);
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+    {
+        size_t n = lengths[l];
+        std::string variant;
+
+        for (int k = 0; k < g_numSearchKernels + 1; k++)
+        {
+            SearchKernel func = k < g_numSearchKernels ? g_searchKernels[k].func : FindPatternHorspool;
+
+            if (k < g_numSearchKernels && g_searchKernels[k].available != NULL && !*g_searchKernels[k].available)
+                continue;
+            if (k == g_numSearchKernels && n < BYTES_HORSPOOL_MIN_LEN)
+                continue;
+
+            variant = (k < g_numSearchKernels ? g_searchKernels[k].name : "horspool") + std::string("/") + std::to_string(n);
+            double seconds = TimeRuns([&]()
+            {
+                hits.clear();
+                func(data, (size_t)size, (size_t)size, &pattern[0], n, 0, hits);
+            }, &runs);
+            Report("search_kernel", variant.c_str(), size, 1, "", 0, runs * size, seconds);
+        }
+    }
+}
+
+/***************************************************************************
+   The byte histogram of -p, on random data and on a run of one value.
+***************************************************************************/
+
+void BenchHistogram(const unsigned char* data, long long size)
+{
+    static uint32_t counts[4][256];
+    std::vector<unsigned char> zeros((size_t)size, 0);
+    long long runs;
+
+    double seconds = TimeRuns([&]() { CountBytes(data, (size_t)size, counts); }, &runs);
+    Report("histogram", "random", size, 1, "", 0, runs * size, seconds);
+    seconds = TimeRuns([&]() { CountBytes(&zeros[0], (size_t)size, counts); }, &runs);
+    Report("histogram", "zeros", size, 1, "", 0, runs * size, seconds);
+}
+
+/***************************************************************************
+   Dump formatting into memory, without any output, for every cell kernel,
+   number format and a range of row widths.
+***************************************************************************/
+
+void BenchFormatter(const unsigned char* data, long long size)
+{
+    static const int widths[] = { 8, 16, 20, 32, 64, 128 };
+    std::vector<char> out(FormattedRowSize(128));
+    BytesConfig config;
+
+    for (int k = 0; k < g_numCellKernels; k++)
+    {
+        if (g_cellKernels[k].available != NULL && !*g_cellKernels[k].available)
+            continue;
+        g_cellKernel = &g_cellKernels[k];
+
+        for (int format = BYTES_DECIMAL_FORMAT; format <= BYTES_HEX_FORMAT; format++)
+        {
+            config.numberFormat = format;
+            for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+            {
+                long long runs, pos, n;
+                volatile size_t sink = 0;
+
+                double seconds = TimeRuns([&]()
+                {
+                    for (pos = 0; pos < size; pos += n)
+                    {
+                        n = size - pos < widths[w] ? size - pos : widths[w];
+                        sink = FormatRow(config, data + pos, (size_t)n, &out[0]);
+                    }
+                }, &runs);
+                Report("format_row", g_cellKernels[k].name, size, 1, format == BYTES_HEX_FORMAT ? "hex" : "dec",
+                       widths[w], runs * size, seconds);
+            }
+        }
+    }
+
+    SelectCellKernel();
+}
+
+/***************************************************************************
+   Write size bytes of synthetic data to path, 4 MB at a time.
+***************************************************************************/
+
+bool MakeSyntheticFile(const std::string& path, long long size)
+{
+    std::vector<unsigned char> block(BYTES_READ_BUFF_SZ);
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file != NULL;
+
+    for (long long pos = 0; ok && pos < size; pos += block.size())
+    {
+        size_t n = (size_t)(size - pos < (long long)block.size() ? size - pos : (long long)block.size());
+        FillSynthetic(&block[0], n, (uint64_t)pos + 1);
+        ok = fwrite(&block[0], 1, n, file) == n;
+    }
+
+    if (file != NULL && fclose(file) != 0)
+        ok = false;
+    return ok;
+}
+
+/***************************************************************************
+   ComputeCRC() and the full dump path (DumpRange() into the null
+   device) on a file, which includes reading it.
+***************************************************************************/
+
+void BenchFile(const std::string& path, long long size)
+{
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    char* filePath = const_cast<char*>(path.c_str());
+    volatile uint64_t sink = 0;
+    long long runs;
+
+    g_printProgress = false;
+    for (int threads = 1; ; threads = maxThreads)
+    {
+        g_numThreads = threads;
+        double seconds = TimeRuns([&]() { sink = ComputeCRC(filePath, size); }, &runs);
+        Report("compute32bitcrc", "auto", size, threads, "", 0, runs * size, seconds);
+        if (threads >= maxThreads)
+            break;
+    }
+    g_numThreads = 1;
+    g_printProgress = true;
+
+    // Dumping writes about eight times the input, so keep it to 256 MB
+    long long dumpSz = size < g_memorySz ? size : g_memorySz;
+    FILE* nullFile;
+    ByteSource src;
+    static const int widths[] = { 16, 20, 64 };
+
+    if (!src.Open(filePath) || (nullFile = fopen(BYTES_NULL_DEVICE, "wb")) == NULL)
+        return;
+
+    for (int format = BYTES_DECIMAL_FORMAT; format <= BYTES_HEX_FORMAT; format++)
+    {
+        g_config.numberFormat = format;
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+        {
+            g_config.numColWidth = widths[w];
+            double seconds = TimeRuns([&]()
+            {
+                OutputBuffer out(nullFile);
+                DumpRange(src, 0, dumpSz, LLONG_MAX, out);
+            }, &runs);
+            Report("dump_range", g_cellKernel->name, dumpSz, 1, format == BYTES_HEX_FORMAT ? "hex" : "dec",
+                   widths[w], runs * dumpSz, seconds);
+        }
+    }
+
+    g_config = BytesConfig();
+    fclose(nullFile);
+}
+
+/***************************************************************************
+   MAIN
+***************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    bool runLarge = false;
+    std::string dir = ".";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-g") == 0)
+            runLarge = true;
+        else if (strncmp(argv[i], "-t", 2) == 0 && atof(argv[i] + 2) > 0)
+            g_minSeconds = atof(argv[i] + 2);
+        else if (strncmp(argv[i], "-d", 2) == 0 && argv[i][2] != 0)
+            dir = argv[i] + 2;
+        else
+        {
+            fprintf(stderr, "Usage:  bytes_bench [-g] [-tSECONDS] [-dDIR]\n");
+            return 1;
+        }
+    }
+
+    g_endianness = DetectEndianness();
+    BytesInit();
+
+    std::vector<unsigned char> data((size_t)g_memorySz);
+    FillSynthetic(&data[0], data.size(), 1);
+
+    BenchCRCKernels(&data[0], g_cacheSz);
+    BenchCRCKernels(&data[0], g_memorySz);
+    BenchCRCAlgorithms(&data[0], g_cacheSz);
+    BenchCRCAlgorithms(&data[0], g_memorySz);
+    BenchSearchKernels(&data[0], g_cacheSz);
+    BenchSearchKernels(&data[0], g_memorySz);
+    BenchHistogram(&data[0], g_cacheSz);
+    BenchHistogram(&data[0], g_memorySz);
+    BenchFormatter(&data[0], g_cacheSz);
+    BenchFormatter(&data[0], g_memorySz);
+
+    std::string path = dir + "/bytes_bench.tmp";
+    long long fileSizes[] = { g_memorySz, g_largeSz };
+
+    for (int i = 0; i < (runLarge ? 2 : 1); i++)
+    {
+        if (!MakeSyntheticFile(path, fileSizes[i]))
+        {
+            fprintf(stderr, "Could not write %s\n", path.c_str());
+            remove(path.c_str());
+            return 1;
+        }
+        BenchFile(path, fileSizes[i]);
+        remove(path.c_str());
+    }
+
+    return 0;
+}
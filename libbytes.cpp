@@ -0,0 +1,1072 @@
+/****************************************************************************
+// libbytes -- the CRC and dump formatting engine of the bytes utility
+//
+// Copyright (c) 1995 - 018 Gerhard W. Gross.
+//
+// Distributed under the same terms as bytes.cpp; see the notice there.
+//
+// See libbytes.h for the interface.
+//
+****************************************************************************/
+
+#ifdef _WIN32
+#include<windows.h>
+#endif
+
+#include "libbytes_internal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <mutex>
+
+#if defined(BYTES_X86)
+bool g_cpuHasPclmul     = false;
+bool g_cpuHasAvx2       = false;
+bool g_cpuHasSse42      = false;
+#elif defined(BYTES_ARM64)
+bool g_cpuHasArmCrc32   = false;
+#endif
+
+/***************************************************************************
+   Query the processor for the instruction set extensions used by the
+   accelerated kernels. Everything stays false on other architectures so
+   only the portable table driven code is used there.
+***************************************************************************/
+
+void DetectCpuFeatures()
+{
+#if defined(BYTES_X86)
+    unsigned int regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+    __cpuid((int*)regs, 1);
+#else
+    __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+    // CPUID leaf 1, ECX bit 1: PCLMULQDQ
+    g_cpuHasPclmul = (regs[2] & (1u << 1)) != 0;
+
+    // ECX bit 20: SSE4.2, which has the CRC-32C instruction
+    g_cpuHasSse42 = (regs[2] & (1u << 20)) != 0;
+
+    // AVX2 needs the CPU flag (leaf 7, EBX bit 5) and the OS saving the
+    // YMM registers (OSXSAVE, leaf 1 ECX bit 27, then XCR0 bits 1 and 2).
+    if (regs[2] & (1u << 27))
+    {
+        unsigned long long xcr0;
+#ifdef _MSC_VER
+        xcr0 = _xgetbv(0);
+        __cpuidex((int*)regs, 7, 0);
+#else
+        unsigned int xcrLo, xcrHi;
+        __asm__ ("xgetbv" : "=a"(xcrLo), "=d"(xcrHi) : "c"(0));
+        xcr0 = ((unsigned long long)xcrHi << 32) | xcrLo;
+        __get_cpuid_count(7, 0, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+        g_cpuHasAvx2 = (xcr0 & 6) == 6 && (regs[1] & (1u << 5)) != 0;
+    }
+#elif defined(BYTES_ARM64)
+#if defined(_WIN32)
+    g_cpuHasArmCrc32 = IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) != 0;
+#elif defined(__linux__)
+    g_cpuHasArmCrc32 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(__APPLE__)
+    g_cpuHasArmCrc32 = true;
+#endif
+#endif
+}
+
+/***************************************************************************
+   CRC lookup tables, generated at compile time from the parameters of the
+   CRC. t[0][n] is the register after feeding in byte n; t[k][n] is that
+   followed by k zero bytes, for folding several bytes per step (slicing).
+   Reflected CRCs shift right and keep the register in the low bits of T;
+   the others shift left and keep it in the high bits, so both take bytes
+   straight into the end of the register that is shifted out first.
+***************************************************************************/
+
+template <typename T, int N>
+struct CRCTableSet
+{
+    T t[N][256] = {};
+};
+
+constexpr uint64_t ReflectBits(uint64_t value, int width)
+{
+    uint64_t reflected = 0;
+
+    for (int i = 0; i < width; i++, value >>= 1)
+        reflected = (reflected << 1) | (value & 1);
+    return reflected;
+}
+
+template <typename T, int N>
+constexpr CRCTableSet<T, N> MakeCRCTables(int width, uint64_t poly, bool reflected)
+{
+    CRCTableSet<T, N> tables;
+    const int bits = (int)sizeof(T) * 8;
+    const T top = (T)1 << (bits - 1);
+    const T rpoly = (T)ReflectBits(poly, width);
+    const T lpoly = (T)(poly << (bits - width));
+
+    for (int n = 0; n < 256; n++)
+    {
+        T reg = reflected ? (T)n : (T)((T)n << (bits - 8));
+
+        for (int j = 0; j < 8; j++)
+        {
+            if (reflected)
+                reg = (reg & 1) ? (T)((reg >> 1) ^ rpoly) : (T)(reg >> 1);
+            else
+                reg = (reg & top) ? (T)((T)(reg << 1) ^ lpoly) : (T)(reg << 1);
+        }
+        tables.t[0][n] = reg;
+    }
+
+    for (int k = 1; k < N; k++)
+    {
+        for (int n = 0; n < 256; n++)
+        {
+            T prev = tables.t[k - 1][n];
+            tables.t[k][n] = reflected ? (T)((prev >> 8) ^ tables.t[0][prev & 0xFF])
+                                       : (T)((T)(prev << 8) ^ tables.t[0][prev >> (bits - 8)]);
+        }
+    }
+
+    return tables;
+}
+
+// The official polynomial used by CRC-32 in PKZip, WinZip and Ethernet.
+static constexpr CRCTableSet<uint32_t, 16> g_crc32Tables = MakeCRCTables<uint32_t, 16>(32, 0x04C11DB7, true);
+
+/***************************************************************************
+   CRC-32 update kernels. Each takes the running (non-inverted) CRC register
+   and returns it advanced over len bytes of buff; the results are identical,
+   only the number of bytes folded per loop iteration differs.
+***************************************************************************/
+
+uint32_t Update32BitCRCByte(uint32_t crc, const unsigned char* buff, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        crc = (crc >> 8) ^ g_crc32Tables.t[0][(crc & 0xFF) ^ buff[i]];
+    return crc;
+}
+
+uint32_t Update32BitCRCSlice8(uint32_t crc, const unsigned char* buff, size_t len)
+{
+    const uint32_t (*t)[256] = g_crc32Tables.t;
+
+    while (len >= 8)
+    {
+        uint32_t a = crc ^ Load32LE(buff);
+        uint32_t b = Load32LE(buff + 4);
+
+        crc = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24] ^
+              t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+
+        buff += 8;
+        len -= 8;
+    }
+
+    return Update32BitCRCByte(crc, buff, len);
+}
+
+uint32_t Update32BitCRCSlice16(uint32_t crc, const unsigned char* buff, size_t len)
+{
+    const uint32_t (*t)[256] = g_crc32Tables.t;
+
+    while (len >= 16)
+    {
+        uint32_t a = crc ^ Load32LE(buff);
+        uint32_t b = Load32LE(buff + 4);
+        uint32_t c = Load32LE(buff + 8);
+        uint32_t d = Load32LE(buff + 12);
+
+        crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+              t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[ 9][(b >> 16) & 0xFF] ^ t[ 8][b >> 24] ^
+              t[ 7][c & 0xFF] ^ t[ 6][(c >> 8) & 0xFF] ^ t[ 5][(c >> 16) & 0xFF] ^ t[ 4][c >> 24] ^
+              t[ 3][d & 0xFF] ^ t[ 2][(d >> 8) & 0xFF] ^ t[ 1][(d >> 16) & 0xFF] ^ t[ 0][d >> 24];
+
+        buff += 16;
+        len -= 16;
+    }
+
+    return Update32BitCRCSlice8(crc, buff, len);
+}
+
+#if defined(BYTES_X86)
+
+/***************************************************************************
+   Fold the CRC over len bytes (len a multiple of 16, at least 64) with
+   carry-less multiplication. Four 128 bit lanes are folded 64 bytes ahead
+   at a time, then folded into one lane, then reduced to 32 bits with a
+   Barrett reduction. The constants are powers of x modulo the reflected
+   CRC-32 polynomial, as given in Intel's "Fast CRC Computation for Generic
+   Polynomials Using PCLMULQDQ Instruction".
+***************************************************************************/
+
+BYTES_TARGET("sse2,pclmul")
+static uint32_t Fold32BitCRCClmul(uint32_t crc, const unsigned char* buff, size_t len)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buff + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buff + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buff + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buff + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    buff += 64;
+    len -= 64;
+
+    // Parallel fold of four lanes, 64 bytes per iteration
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buff + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buff + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buff + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buff + 0x30)));
+
+        buff += 64;
+        len -= 64;
+    }
+
+    // Fold the four lanes into one
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Single lane folds for whatever is left
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)buff);
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buff += 16;
+        len -= 16;
+    }
+
+    // Fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_and_si128(x1, mask32);
+    x0 = _mm_clmulepi64_si128(x0, poly, 0x10);
+    x0 = _mm_and_si128(x0, mask32);
+    x0 = _mm_clmulepi64_si128(x0, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x0);
+
+    return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+uint32_t Update32BitCRCClmul(uint32_t crc, const unsigned char* buff, size_t len)
+{
+    if (len >= 64)
+    {
+        size_t chunk = len & ~(size_t)15;
+        crc = Fold32BitCRCClmul(crc, buff, chunk);
+        buff += chunk;
+        len -= chunk;
+    }
+
+    return Update32BitCRCSlice16(crc, buff, len);
+}
+
+#endif // BYTES_X86
+
+#if defined(BYTES_ARM64)
+
+/***************************************************************************
+   ARMv8 has CRC-32 instructions for exactly this polynomial, consuming
+   eight bytes per instruction.
+***************************************************************************/
+
+#if defined(__GNUC__) && !defined(__clang__)
+BYTES_TARGET("+crc")
+#elif defined(__clang__)
+BYTES_TARGET("crc")
+#endif
+uint32_t Update32BitCRCArmv8(uint32_t crc, const unsigned char* buff, size_t len)
+{
+    uint64_t word;
+
+    while (len >= 8)
+    {
+        memcpy(&word, buff, 8);
+        crc = __crc32d(crc, word);
+        buff += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = __crc32b(crc, *buff++);
+
+    return crc;
+}
+
+#endif // BYTES_ARM64
+
+/***************************************************************************
+   The CRC-32 kernels known to this program, slowest first. The last one
+   the CPU supports is used unless a kernel is forced with -k.
+***************************************************************************/
+
+const CRC32KernelInfo g_crc32Kernels[] =
+{
+    { "byte",       Update32BitCRCByte,     NULL },
+    { "slice8",     Update32BitCRCSlice8,   NULL },
+    { "slice16",    Update32BitCRCSlice16,  NULL },
+#if defined(BYTES_X86)
+    { "clmul",      Update32BitCRCClmul,    &g_cpuHasPclmul },
+#endif
+#if defined(BYTES_ARM64)
+    { "armv8",      Update32BitCRCArmv8,    &g_cpuHasArmCrc32 },
+#endif
+};
+
+const int g_numCrc32Kernels = sizeof(g_crc32Kernels) / sizeof(g_crc32Kernels[0]);
+
+CRC32Kernel g_crc32Kernel = Update32BitCRCSlice16;
+
+// The CRC-32 kernel called name, or with no name the fastest one this CPU
+// supports. NULL if there is no kernel called name.
+const CRC32KernelInfo* FindCRC32Kernel(const char* name)
+{
+    int k;
+
+    if (name == NULL || *name == 0)
+    {
+        for (k = g_numCrc32Kernels - 1; k > 0; k--)
+        {
+            if (g_crc32Kernels[k].available == NULL || *g_crc32Kernels[k].available)
+                break;
+        }
+        return &g_crc32Kernels[k];
+    }
+
+    for (k = 0; k < g_numCrc32Kernels; k++)
+    {
+        if (strcmp(name, g_crc32Kernels[k].name) == 0)
+            return &g_crc32Kernels[k];
+    }
+    return NULL;
+}
+
+/***************************************************************************
+   Generic CRC engine for any CRC up to 64 bits wide, in the usual
+   parameter model (width, polynomial, initial value, bit reflection and
+   final XOR; reflected CRCs here reflect both input and output). The
+   register is kept in 64 bits, in the low bits for reflected CRCs and in
+   the high bits for the others, and eight bytes are folded per step with
+   the compile time tables.
+***************************************************************************/
+
+template <int Width, uint64_t Poly, uint64_t Init, bool Reflected, uint64_t XorOut>
+struct CRCEngine
+{
+    static constexpr int width = Width;
+    static constexpr uint64_t poly = Poly;
+    static constexpr uint64_t init = Init;
+    static constexpr bool reflected = Reflected;
+    static constexpr uint64_t xorOut = XorOut;
+    static constexpr CRCTableSet<uint64_t, 8> tables = MakeCRCTables<uint64_t, 8>(Width, Poly, Reflected);
+
+    static constexpr uint64_t InitRegister()
+    {
+        return Reflected ? ReflectBits(Init, Width) : Init << (64 - Width);
+    }
+
+    static constexpr uint64_t Finalize(uint64_t reg)
+    {
+        return (Reflected ? reg : reg >> (64 - Width)) ^ XorOut;
+    }
+
+    // One byte at a time; usable at compile time
+    static constexpr uint64_t UpdateBytes(uint64_t reg, const char* buff, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            if (Reflected)
+                reg = (reg >> 8) ^ tables.t[0][(reg ^ (unsigned char)buff[i]) & 0xFF];
+            else
+                reg = (reg << 8) ^ tables.t[0][(reg >> 56) ^ (unsigned char)buff[i]];
+        }
+        return reg;
+    }
+
+    // The CRC of "123456789", the standard check value of a CRC model
+    static constexpr uint64_t Check()
+    {
+        return Finalize(UpdateBytes(InitRegister(), "123456789", 9));
+    }
+
+    static uint64_t Update(uint64_t reg, const unsigned char* buff, size_t len)
+    {
+        const uint64_t (*t)[256] = tables.t;
+        uint64_t x;
+
+        for (; len >= 8; buff += 8, len -= 8)
+        {
+            if (Reflected)
+            {
+                x = reg ^ Load64LE(buff);
+                reg = t[7][x & 0xFF] ^ t[6][(x >> 8) & 0xFF] ^ t[5][(x >> 16) & 0xFF] ^ t[4][(x >> 24) & 0xFF] ^
+                      t[3][(x >> 32) & 0xFF] ^ t[2][(x >> 40) & 0xFF] ^ t[1][(x >> 48) & 0xFF] ^ t[0][x >> 56];
+            }
+            else
+            {
+                x = reg ^ Load64BE(buff);
+                reg = t[7][x >> 56] ^ t[6][(x >> 48) & 0xFF] ^ t[5][(x >> 40) & 0xFF] ^ t[4][(x >> 32) & 0xFF] ^
+                      t[3][(x >> 24) & 0xFF] ^ t[2][(x >> 16) & 0xFF] ^ t[1][(x >> 8) & 0xFF] ^ t[0][x & 0xFF];
+            }
+        }
+
+        return UpdateBytes(reg, (const char*)buff, len);
+    }
+};
+
+typedef CRCEngine<16, 0x1021,             0xFFFF,             false, 0>                  CRC16CcittEngine;
+typedef CRCEngine<32, 0x04C11DB7,         0xFFFFFFFF,         true,  0xFFFFFFFF>         CRC32Engine;
+typedef CRCEngine<32, 0x1EDC6F41,         0xFFFFFFFF,         true,  0xFFFFFFFF>         CRC32CEngine;
+typedef CRCEngine<64, 0x42F0E1EBA9EA3693, 0,                  false, 0>                  CRC64EcmaEngine;
+typedef CRCEngine<64, 0x42F0E1EBA9EA3693, 0xFFFFFFFFFFFFFFFF, true,  0xFFFFFFFFFFFFFFFF> CRC64XzEngine;
+
+static_assert(CRC16CcittEngine::Check() == 0x29B1, "CRC-16/CCITT-FALSE check value");
+static_assert(CRC32Engine::Check() == 0xCBF43926, "CRC-32 check value");
+static_assert(CRC32CEngine::Check() == 0xE3069283, "CRC-32C check value");
+static_assert(CRC64EcmaEngine::Check() == 0x6C40DF5F0B497347, "CRC-64/ECMA-182 check value");
+static_assert(CRC64XzEngine::Check() == 0x995DC9BBDF1939FA, "CRC-64/XZ check value");
+static_assert(CRC32Engine::tables.t[0][0x80] == g_crc32Tables.t[0][0x80], "CRC-32 kernels use the same polynomial");
+
+#if defined(BYTES_X86)
+
+/***************************************************************************
+   SSE4.2 has an instruction for CRC-32C (the Castagnoli polynomial), eight
+   bytes at a time on 64 bit builds.
+***************************************************************************/
+
+BYTES_TARGET("sse4.2")
+uint64_t UpdateCRC32CSse42(uint64_t reg, const unsigned char* buff, size_t len)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    uint64_t word;
+
+    for (; len >= 8; buff += 8, len -= 8)
+    {
+        memcpy(&word, buff, 8);
+        reg = _mm_crc32_u64(reg, word);
+    }
+#else
+    uint32_t word;
+
+    for (; len >= 4; buff += 4, len -= 4)
+    {
+        memcpy(&word, buff, 4);
+        reg = _mm_crc32_u32((uint32_t)reg, word);
+    }
+#endif
+    for (; len > 0; buff++, len--)
+        reg = _mm_crc32_u8((uint32_t)reg, *buff);
+    return reg;
+}
+
+#endif // BYTES_X86
+
+#if defined(BYTES_ARM64)
+
+#if defined(__GNUC__) && !defined(__clang__)
+BYTES_TARGET("+crc")
+#elif defined(__clang__)
+BYTES_TARGET("crc")
+#endif
+uint64_t UpdateCRC32CArmv8(uint64_t reg, const unsigned char* buff, size_t len)
+{
+    uint32_t crc = (uint32_t)reg;
+    uint64_t word;
+
+    for (; len >= 8; buff += 8, len -= 8)
+    {
+        memcpy(&word, buff, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; len > 0; buff++, len--)
+        crc = __crc32cb(crc, *buff);
+    return crc;
+}
+
+#endif // BYTES_ARM64
+
+// CRC-32 goes through the kernel chosen with -k
+uint64_t UpdateCRC32(uint64_t reg, const unsigned char* buff, size_t len)
+{
+    return g_crc32Kernel((uint32_t)reg, buff, len);
+}
+
+uint64_t UpdateCRC32C(uint64_t reg, const unsigned char* buff, size_t len)
+{
+#if defined(BYTES_X86)
+    if (g_cpuHasSse42)
+        return UpdateCRC32CSse42(reg, buff, len);
+#elif defined(BYTES_ARM64)
+    if (g_cpuHasArmCrc32)
+        return UpdateCRC32CArmv8(reg, buff, len);
+#endif
+    return CRC32CEngine::Update(reg, buff, len);
+}
+
+/***************************************************************************
+   The CRCs that can be chosen with -a, and the calls that work on any of
+   them: CRCInit() gives the starting register, CRCUpdate() feeds bytes
+   in, CRCFinalize() turns the register into the CRC value, CRCShift()
+   feeds in zero bytes without touching them and CRCCombine() gives the CRC
+   of two pieces of data back to back from their CRCs.
+***************************************************************************/
+
+#define BYTES_CRC_ALGORITHM(name, title, Engine, update) \
+    { name, title, Engine::width, Engine::poly, Engine::init, Engine::reflected, Engine::xorOut, update }
+
+const CRCAlgorithm g_crcAlgorithms[] =
+{
+    BYTES_CRC_ALGORITHM("crc16",    "CRC-16/CCITT-FALSE",   CRC16CcittEngine,   CRC16CcittEngine::Update),
+    BYTES_CRC_ALGORITHM("crc32",    "CRC32",                CRC32Engine,        UpdateCRC32),
+    BYTES_CRC_ALGORITHM("crc32c",   "CRC-32C",              CRC32CEngine,       UpdateCRC32C),
+    BYTES_CRC_ALGORITHM("crc64",    "CRC-64/ECMA-182",      CRC64EcmaEngine,    CRC64EcmaEngine::Update),
+    BYTES_CRC_ALGORITHM("crc64xz",  "CRC-64/XZ",            CRC64XzEngine,      CRC64XzEngine::Update),
+};
+
+const int g_numCrcAlgorithms = sizeof(g_crcAlgorithms) / sizeof(g_crcAlgorithms[0]);
+
+// The CRC called name, or NULL
+const CRCAlgorithm* FindCRCAlgorithm(const char* name)
+{
+    for (int a = 0; a < g_numCrcAlgorithms; a++)
+    {
+        if (strcmp(name, g_crcAlgorithms[a].name) == 0)
+            return &g_crcAlgorithms[a];
+    }
+    return NULL;
+}
+
+uint64_t CRCInit(const CRCAlgorithm& alg)
+{
+    return alg.reflected ? ReflectBits(alg.init, alg.width) : alg.init << (64 - alg.width);
+}
+
+uint64_t CRCUpdate(const CRCAlgorithm& alg, uint64_t reg, const unsigned char* buff, size_t len)
+{
+    return alg.update(reg, buff, len);
+}
+
+uint64_t CRCFinalize(const CRCAlgorithm& alg, uint64_t reg)
+{
+    return (alg.reflected ? reg : reg >> (64 - alg.width)) ^ alg.xorOut;
+}
+
+/* The register as a polynomial in the usual order (x^0 in bit 0), and
+   back. Shifting and combining are done in that form. */
+
+static uint64_t RegisterToPoly(const CRCAlgorithm& alg, uint64_t reg)
+{
+    return alg.reflected ? ReflectBits(reg, alg.width) : reg >> (64 - alg.width);
+}
+
+static uint64_t PolyToRegister(const CRCAlgorithm& alg, uint64_t p)
+{
+    return alg.reflected ? ReflectBits(p, alg.width) : p << (64 - alg.width);
+}
+
+// Multiply a by b modulo the CRC polynomial, Horner style from the top bit of a
+static uint64_t MultModPoly(const CRCAlgorithm& alg, uint64_t a, uint64_t b)
+{
+    uint64_t top = (uint64_t)1 << (alg.width - 1);
+    uint64_t mask = top | (top - 1);
+    uint64_t p = 0;
+
+    for (int i = alg.width - 1; i >= 0; i--)
+    {
+        p = (p & top) ? ((p << 1) ^ alg.poly) & mask : (p << 1) & mask;
+        if ((a >> i) & 1)
+            p ^= b;
+    }
+    return p;
+}
+
+// Return x^(8n) modulo the CRC polynomial, by repeated squaring
+static uint64_t XPow8nModPoly(const CRCAlgorithm& alg, long long n)
+{
+    uint64_t result = 1, square = 1;
+
+    for (int i = 0; i < 8; i++)
+        square = MultModPoly(alg, square, 2);
+
+    for (; n > 0; n >>= 1)
+    {
+        if (n & 1)
+            result = MultModPoly(alg, result, square);
+        square = MultModPoly(alg, square, square);
+    }
+    return result;
+}
+
+// Advance the register over len zero bytes without touching them, e.g.
+// for a hole in a sparse file. Appending zeros multiplies by x^(8 len).
+uint64_t CRCShift(const CRCAlgorithm& alg, uint64_t reg, long long len)
+{
+    if (len <= 0)
+        return reg;
+    return PolyToRegister(alg, MultModPoly(alg, RegisterToPoly(alg, reg), XPow8nModPoly(alg, len)));
+}
+
+// Return the CRC of A followed by B given crc1 = CRC(A), crc2 = CRC(B) and
+// len2 = the length of B. Feeding in B is linear in the register, so the
+// register after A||B is the register after A shifted over B, plus that
+// of B started from zero rather than from the initial value.
+uint64_t CRCCombine(const CRCAlgorithm& alg, uint64_t crc1, uint64_t crc2, long long len2)
+{
+    uint64_t init = CRCInit(alg);
+    uint64_t reg1 = alg.reflected ? crc1 ^ alg.xorOut : (crc1 ^ alg.xorOut) << (64 - alg.width);
+    uint64_t reg2 = alg.reflected ? crc2 ^ alg.xorOut : (crc2 ^ alg.xorOut) << (64 - alg.width);
+
+    return CRCFinalize(alg, CRCShift(alg, reg1, len2) ^ reg2 ^ CRCShift(alg, init, len2));
+}
+
+/***************************************************************************
+   Pre-rendered output cells. Every byte value has a 4 character cell for
+   the character row ("%4.1c" of the character, or blank if it is not
+   printable) and for the number row ("%4.1X" or "%4.1u"). The cells are
+   produced by the same printf formats the dump always used, so output is
+   unchanged; rows are then assembled by copying cells.
+***************************************************************************/
+
+char g_charCells[256][BYTES_CELL_WIDTH];
+char g_hexCells[256][BYTES_CELL_WIDTH];
+char g_decCells[256][BYTES_CELL_WIDTH];
+
+void MakeCellTables()
+{
+    char cell[16];
+
+    for (int i = 0; i <= 0xFF; i++)
+    {
+        snprintf(cell, sizeof(cell), "%4.1c", (i > 127 || !isprint(i)) ? ' ' : (char)i);
+        memcpy(g_charCells[i], cell, BYTES_CELL_WIDTH);
+        snprintf(cell, sizeof(cell), "%4.1X", (unsigned int)i);
+        memcpy(g_hexCells[i], cell, BYTES_CELL_WIDTH);
+        snprintf(cell, sizeof(cell), "%4.1u", (unsigned int)i);
+        memcpy(g_decCells[i], cell, BYTES_CELL_WIDTH);
+    }
+}
+
+/***************************************************************************
+   Cell renderers: expand n bytes into n cells of one kind. The scalar ones
+   copy cells from the tables above; the vector ones compute 16 or 32 cells
+   at a time in registers, one cell per 32 bit lane, and use the tables only
+   for the last few bytes. In a lane holding byte value v the cell is, in
+   memory order:
+       char:    ' ' ' ' ' ' c       c = v if 0x20 <= v <= 0x7E, else ' '
+       hex:     ' ' ' ' h1  h0      h1 = ' ' if v < 0x10
+       decimal: ' ' d2  d1  d0      d2 = ' ' if v < 100, d1 = ' ' if v < 10
+   exactly as the tables have them.
+***************************************************************************/
+
+static inline void RenderCellsFromTable(const char (*cells)[BYTES_CELL_WIDTH], const unsigned char* data, size_t n, char* out)
+{
+    for (size_t j = 0; j < n; j++, out += BYTES_CELL_WIDTH)
+        memcpy(out, cells[data[j]], BYTES_CELL_WIDTH);
+}
+
+void RenderCharCellsScalar(const unsigned char* data, size_t n, char* out) { RenderCellsFromTable(g_charCells, data, n, out); }
+void RenderHexCellsScalar(const unsigned char* data, size_t n, char* out)  { RenderCellsFromTable(g_hexCells, data, n, out); }
+void RenderDecCellsScalar(const unsigned char* data, size_t n, char* out)  { RenderCellsFromTable(g_decCells, data, n, out); }
+
+#if defined(BYTES_X86)
+
+// One step per cell kind for four byte values in 32 bit lanes
+
+BYTES_TARGET("sse2")
+static inline __m128i CharCellsSSE2(__m128i v)
+{
+    __m128i isPrint = _mm_and_si128(_mm_cmpgt_epi32(v, _mm_set1_epi32(0x1F)), _mm_cmplt_epi32(v, _mm_set1_epi32(0x7F)));
+    __m128i c = _mm_or_si128(_mm_and_si128(isPrint, v), _mm_andnot_si128(isPrint, _mm_set1_epi32(' ')));
+    return _mm_or_si128(_mm_set1_epi32(0x00202020), _mm_slli_epi32(c, 24));
+}
+
+BYTES_TARGET("sse2")
+static inline __m128i HexDigitsSSE2(__m128i x)
+{
+    // '0'..'9' then 'A'..'F'
+    return _mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32('0')), _mm_and_si128(_mm_cmpgt_epi32(x, _mm_set1_epi32(9)), _mm_set1_epi32(7)));
+}
+
+BYTES_TARGET("sse2")
+static inline __m128i HexCellsSSE2(__m128i v)
+{
+    const __m128i space = _mm_set1_epi32(' ');
+    __m128i h0 = HexDigitsSSE2(_mm_and_si128(v, _mm_set1_epi32(0xF)));
+    __m128i h1 = HexDigitsSSE2(_mm_srli_epi32(v, 4));
+    __m128i two = _mm_cmpgt_epi32(v, _mm_set1_epi32(0xF));
+
+    h1 = _mm_or_si128(_mm_and_si128(two, h1), _mm_andnot_si128(two, space));
+    return _mm_or_si128(_mm_set1_epi32(0x00002020), _mm_or_si128(_mm_slli_epi32(h1, 16), _mm_slli_epi32(h0, 24)));
+}
+
+BYTES_TARGET("sse2")
+static inline __m128i DecCellsSSE2(__m128i v)
+{
+    const __m128i space = _mm_set1_epi32(' ');
+    const __m128i zero = _mm_set1_epi32('0');
+
+    // v / 100 and v / 10 by multiply and shift; exact for v < 256 and
+    // r < 100. The products fit in the low 16 bits of each lane.
+    __m128i d2 = _mm_srli_epi16(_mm_mullo_epi16(v, _mm_set1_epi32(41)), 12);
+    __m128i r = _mm_sub_epi16(v, _mm_mullo_epi16(d2, _mm_set1_epi32(100)));
+    __m128i d1 = _mm_srli_epi16(_mm_mullo_epi16(r, _mm_set1_epi32(205)), 11);
+    __m128i d0 = _mm_sub_epi16(r, _mm_mullo_epi16(d1, _mm_set1_epi32(10)));
+    __m128i three = _mm_cmpgt_epi32(v, _mm_set1_epi32(99));
+    __m128i two = _mm_cmpgt_epi32(v, _mm_set1_epi32(9));
+
+    d2 = _mm_or_si128(_mm_and_si128(three, _mm_add_epi32(d2, zero)), _mm_andnot_si128(three, space));
+    d1 = _mm_or_si128(_mm_and_si128(two, _mm_add_epi32(d1, zero)), _mm_andnot_si128(two, space));
+    d0 = _mm_add_epi32(d0, zero);
+    return _mm_or_si128(_mm_or_si128(space, _mm_slli_epi32(d2, 8)), _mm_or_si128(_mm_slli_epi32(d1, 16), _mm_slli_epi32(d0, 24)));
+}
+
+// Widen 16 bytes to four vectors of 32 bit lanes, render and store 64 chars
+#define BYTES_RENDER_SSE2(CELLS, data, out)                                          \
+    {                                                                               \
+        const __m128i zero = _mm_setzero_si128();                                   \
+        __m128i x = _mm_loadu_si128((const __m128i*)(data));                        \
+        __m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);   \
+        _mm_storeu_si128((__m128i*)(out) + 0, CELLS(_mm_unpacklo_epi16(lo, zero))); \
+        _mm_storeu_si128((__m128i*)(out) + 1, CELLS(_mm_unpackhi_epi16(lo, zero))); \
+        _mm_storeu_si128((__m128i*)(out) + 2, CELLS(_mm_unpacklo_epi16(hi, zero))); \
+        _mm_storeu_si128((__m128i*)(out) + 3, CELLS(_mm_unpackhi_epi16(hi, zero))); \
+    }
+
+BYTES_TARGET("sse2")
+void RenderCharCellsSSE2(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 16; n -= 16, data += 16, out += 16 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_SSE2(CharCellsSSE2, data, out)
+    RenderCellsFromTable(g_charCells, data, n, out);
+}
+
+BYTES_TARGET("sse2")
+void RenderHexCellsSSE2(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 16; n -= 16, data += 16, out += 16 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_SSE2(HexCellsSSE2, data, out)
+    RenderCellsFromTable(g_hexCells, data, n, out);
+}
+
+BYTES_TARGET("sse2")
+void RenderDecCellsSSE2(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 16; n -= 16, data += 16, out += 16 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_SSE2(DecCellsSSE2, data, out)
+    RenderCellsFromTable(g_decCells, data, n, out);
+}
+
+// The same steps on eight lanes
+
+BYTES_TARGET("avx2")
+static inline __m256i CharCellsAVX2(__m256i v)
+{
+    __m256i isPrint = _mm256_and_si256(_mm256_cmpgt_epi32(v, _mm256_set1_epi32(0x1F)), _mm256_cmpgt_epi32(_mm256_set1_epi32(0x7F), v));
+    __m256i c = _mm256_blendv_epi8(_mm256_set1_epi32(' '), v, isPrint);
+    return _mm256_or_si256(_mm256_set1_epi32(0x00202020), _mm256_slli_epi32(c, 24));
+}
+
+BYTES_TARGET("avx2")
+static inline __m256i HexDigitsAVX2(__m256i x)
+{
+    return _mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32('0')), _mm256_and_si256(_mm256_cmpgt_epi32(x, _mm256_set1_epi32(9)), _mm256_set1_epi32(7)));
+}
+
+BYTES_TARGET("avx2")
+static inline __m256i HexCellsAVX2(__m256i v)
+{
+    __m256i h0 = HexDigitsAVX2(_mm256_and_si256(v, _mm256_set1_epi32(0xF)));
+    __m256i h1 = HexDigitsAVX2(_mm256_srli_epi32(v, 4));
+
+    h1 = _mm256_blendv_epi8(_mm256_set1_epi32(' '), h1, _mm256_cmpgt_epi32(v, _mm256_set1_epi32(0xF)));
+    return _mm256_or_si256(_mm256_set1_epi32(0x00002020), _mm256_or_si256(_mm256_slli_epi32(h1, 16), _mm256_slli_epi32(h0, 24)));
+}
+
+BYTES_TARGET("avx2")
+static inline __m256i DecCellsAVX2(__m256i v)
+{
+    const __m256i space = _mm256_set1_epi32(' ');
+    const __m256i zero = _mm256_set1_epi32('0');
+    __m256i d2 = _mm256_srli_epi16(_mm256_mullo_epi16(v, _mm256_set1_epi32(41)), 12);
+    __m256i r = _mm256_sub_epi16(v, _mm256_mullo_epi16(d2, _mm256_set1_epi32(100)));
+    __m256i d1 = _mm256_srli_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi32(205)), 11);
+    __m256i d0 = _mm256_sub_epi16(r, _mm256_mullo_epi16(d1, _mm256_set1_epi32(10)));
+
+    d2 = _mm256_blendv_epi8(space, _mm256_add_epi32(d2, zero), _mm256_cmpgt_epi32(v, _mm256_set1_epi32(99)));
+    d1 = _mm256_blendv_epi8(space, _mm256_add_epi32(d1, zero), _mm256_cmpgt_epi32(v, _mm256_set1_epi32(9)));
+    d0 = _mm256_add_epi32(d0, zero);
+    return _mm256_or_si256(_mm256_or_si256(space, _mm256_slli_epi32(d2, 8)), _mm256_or_si256(_mm256_slli_epi32(d1, 16), _mm256_slli_epi32(d0, 24)));
+}
+
+// Widen 32 bytes, eight at a time, render and store 128 chars
+#define BYTES_RENDER_AVX2(CELLS, data, out)                                                                     \
+    {                                                                                                          \
+        for (int q = 0; q < 4; q++)                                                                            \
+        {                                                                                                      \
+            __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)((data) + 8 * q)));               \
+            _mm256_storeu_si256((__m256i*)(out) + q, CELLS(v));                                                \
+        }                                                                                                      \
+    }
+
+BYTES_TARGET("avx2")
+void RenderCharCellsAVX2(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 32; n -= 32, data += 32, out += 32 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_AVX2(CharCellsAVX2, data, out)
+    RenderCharCellsSSE2(data, n, out);
+}
+
+BYTES_TARGET("avx2")
+void RenderHexCellsAVX2(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 32; n -= 32, data += 32, out += 32 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_AVX2(HexCellsAVX2, data, out)
+    RenderHexCellsSSE2(data, n, out);
+}
+
+BYTES_TARGET("avx2")
+void RenderDecCellsAVX2(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 32; n -= 32, data += 32, out += 32 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_AVX2(DecCellsAVX2, data, out)
+    RenderDecCellsSSE2(data, n, out);
+}
+
+#endif // BYTES_X86
+
+#if defined(BYTES_ARM64)
+
+static inline uint32x4_t CharCellsNEON(uint32x4_t v)
+{
+    uint32x4_t isPrint = vandq_u32(vcgtq_u32(v, vdupq_n_u32(0x1F)), vcltq_u32(v, vdupq_n_u32(0x7F)));
+    uint32x4_t c = vbslq_u32(isPrint, v, vdupq_n_u32(' '));
+    return vorrq_u32(vdupq_n_u32(0x00202020), vshlq_n_u32(c, 24));
+}
+
+static inline uint32x4_t HexDigitsNEON(uint32x4_t x)
+{
+    return vaddq_u32(vaddq_u32(x, vdupq_n_u32('0')), vandq_u32(vcgtq_u32(x, vdupq_n_u32(9)), vdupq_n_u32(7)));
+}
+
+static inline uint32x4_t HexCellsNEON(uint32x4_t v)
+{
+    uint32x4_t h0 = HexDigitsNEON(vandq_u32(v, vdupq_n_u32(0xF)));
+    uint32x4_t h1 = HexDigitsNEON(vshrq_n_u32(v, 4));
+
+    h1 = vbslq_u32(vcgtq_u32(v, vdupq_n_u32(0xF)), h1, vdupq_n_u32(' '));
+    return vorrq_u32(vdupq_n_u32(0x00002020), vorrq_u32(vshlq_n_u32(h1, 16), vshlq_n_u32(h0, 24)));
+}
+
+static inline uint32x4_t DecCellsNEON(uint32x4_t v)
+{
+    const uint32x4_t space = vdupq_n_u32(' ');
+    const uint32x4_t zero = vdupq_n_u32('0');
+    uint32x4_t d2 = vshrq_n_u32(vmulq_n_u32(v, 41), 12);
+    uint32x4_t r = vmlsq_n_u32(v, d2, 100);
+    uint32x4_t d1 = vshrq_n_u32(vmulq_n_u32(r, 205), 11);
+    uint32x4_t d0 = vmlsq_n_u32(r, d1, 10);
+
+    d2 = vbslq_u32(vcgtq_u32(v, vdupq_n_u32(99)), vaddq_u32(d2, zero), space);
+    d1 = vbslq_u32(vcgtq_u32(v, vdupq_n_u32(9)), vaddq_u32(d1, zero), space);
+    d0 = vaddq_u32(d0, zero);
+    return vorrq_u32(vorrq_u32(space, vshlq_n_u32(d2, 8)), vorrq_u32(vshlq_n_u32(d1, 16), vshlq_n_u32(d0, 24)));
+}
+
+// Widen 16 bytes to four vectors of 32 bit lanes, render and store 64 chars
+#define BYTES_RENDER_NEON(CELLS, data, out)                                                      \
+    {                                                                                           \
+        uint8x16_t x = vld1q_u8(data);                                                          \
+        uint16x8_t lo = vmovl_u8(vget_low_u8(x)), hi = vmovl_u8(vget_high_u8(x));               \
+        vst1q_u8((uint8_t*)(out) + 0,  vreinterpretq_u8_u32(CELLS(vmovl_u16(vget_low_u16(lo)))));  \
+        vst1q_u8((uint8_t*)(out) + 16, vreinterpretq_u8_u32(CELLS(vmovl_u16(vget_high_u16(lo))))); \
+        vst1q_u8((uint8_t*)(out) + 32, vreinterpretq_u8_u32(CELLS(vmovl_u16(vget_low_u16(hi)))));  \
+        vst1q_u8((uint8_t*)(out) + 48, vreinterpretq_u8_u32(CELLS(vmovl_u16(vget_high_u16(hi))))); \
+    }
+
+void RenderCharCellsNEON(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 16; n -= 16, data += 16, out += 16 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_NEON(CharCellsNEON, data, out)
+    RenderCellsFromTable(g_charCells, data, n, out);
+}
+
+void RenderHexCellsNEON(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 16; n -= 16, data += 16, out += 16 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_NEON(HexCellsNEON, data, out)
+    RenderCellsFromTable(g_hexCells, data, n, out);
+}
+
+void RenderDecCellsNEON(const unsigned char* data, size_t n, char* out)
+{
+    for (; n >= 16; n -= 16, data += 16, out += 16 * BYTES_CELL_WIDTH)
+        BYTES_RENDER_NEON(DecCellsNEON, data, out)
+    RenderCellsFromTable(g_decCells, data, n, out);
+}
+
+#endif // BYTES_ARM64
+
+/***************************************************************************
+   The cell renderers known to this program, slowest first. The last one
+   the CPU supports is used. The vector kernels assume little endian lane
+   layout, which holds for every x86 and ARM64 target.
+***************************************************************************/
+
+const CellKernelInfo g_cellKernels[] =
+{
+    { "scalar", RenderCharCellsScalar,  RenderHexCellsScalar,   RenderDecCellsScalar,   NULL },
+#if defined(BYTES_X86)
+    { "sse2",   RenderCharCellsSSE2,    RenderHexCellsSSE2,     RenderDecCellsSSE2,     NULL },
+    { "avx2",   RenderCharCellsAVX2,    RenderHexCellsAVX2,     RenderDecCellsAVX2,     &g_cpuHasAvx2 },
+#endif
+#if defined(BYTES_ARM64)
+    { "neon",   RenderCharCellsNEON,    RenderHexCellsNEON,     RenderDecCellsNEON,     NULL },
+#endif
+};
+
+const int g_numCellKernels = sizeof(g_cellKernels) / sizeof(g_cellKernels[0]);
+
+const CellKernelInfo* g_cellKernel = &g_cellKernels[0];
+
+void SelectCellKernel()
+{
+    int k;
+
+    for (k = g_numCellKernels - 1; k > 0; k--)
+    {
+        if (g_cellKernels[k].available == NULL || *g_cellKernels[k].available)
+            break;
+    }
+    g_cellKernel = &g_cellKernels[k];
+}
+
+// Render one row of the dump; see FormattedRowSize()
+size_t FormatRow(const BytesConfig& config, const unsigned char* data, size_t n, char* out)
+{
+    char* p = out;
+
+    g_cellKernel->chars(data, n, p);
+    p += n * BYTES_CELL_WIDTH;
+    *p++ = '\n';
+
+    if (config.numberFormat == BYTES_HEX_FORMAT)
+        g_cellKernel->hex(data, n, p);
+    else
+        g_cellKernel->dec(data, n, p);
+    p += n * BYTES_CELL_WIDTH;
+    *p++ = '\n';
+    *p++ = '\n';
+
+    return p - out;
+}
+
+/***************************************************************************
+   Public interface; see libbytes.h.
+***************************************************************************/
+
+void BytesInit()
+{
+    static std::once_flag once;
+
+    std::call_once(once, []()
+    {
+        DetectCpuFeatures();
+        g_crc32Kernel = FindCRC32Kernel(NULL)->func;
+        MakeCellTables();
+        SelectCellKernel();
+    });
+}
+
+size_t BytesFormatSize(const BytesConfig& config, size_t len)
+{
+    size_t width = config.numColWidth > 0 ? (size_t)config.numColWidth : BYTES_DEF_NUM_COLS;
+    size_t rows = (len + width - 1) / width;
+
+    return 2 * len * BYTES_CELL_WIDTH + 3 * rows;
+}
+
+size_t BytesFormat(const BytesConfig& config, const void* data, size_t len, char* out, size_t outSz)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t width = config.numColWidth > 0 ? (size_t)config.numColWidth : BYTES_DEF_NUM_COLS;
+    size_t off, rowLen;
+    char* p = out;
+
+    if (outSz < BytesFormatSize(config, len))
+        return 0;
+
+    for (off = 0; off < len; off += rowLen)
+    {
+        rowLen = len - off < width ? len - off : width;
+        p += FormatRow(config, bytes + off, rowLen, p);
+    }
+    return p - out;
+}
+
+bool BytesCRCStart(BytesCRC& crc, const char* name)
+{
+    crc.alg = FindCRCAlgorithm(name != NULL ? name : "crc32");
+    if (crc.alg == NULL)
+        return false;
+    crc.reg = CRCInit(*crc.alg);
+    return true;
+}
+
+void BytesCRCUpdate(BytesCRC& crc, const void* data, size_t len)
+{
+    crc.reg = CRCUpdate(*crc.alg, crc.reg, (const unsigned char*)data, len);
+}
+
+void BytesCRCZeros(BytesCRC& crc, long long len)
+{
+    crc.reg = CRCShift(*crc.alg, crc.reg, len);
+}
+
+uint64_t BytesCRCValue(const BytesCRC& crc)
+{
+    return CRCFinalize(*crc.alg, crc.reg);
+}
+
+uint64_t BytesCRCCombine(const BytesCRC& crc, uint64_t crc1, uint64_t crc2, long long len2)
+{
+    return CRCCombine(*crc.alg, crc1, crc2, len2);
+}
@@ -0,0 +1,91 @@
+/****************************************************************************
+// libbytes -- the CRC and dump formatting engine of the bytes utility
+//
+// Copyright (c) 1995 - 018 Gerhard W. Gross.
+//
+// Distributed under the same terms as bytes.cpp; see the notice there.
+//
+// Build libbytes.cpp into a program to compute CRCs and format dump rows
+// in process, without starting bytes for each file. Nothing here reads
+// files, allocates memory or keeps per-call state in globals: the caller
+// hands in the bytes and the output buffer, and the layout comes from a
+// BytesConfig, so any number of threads may use it at once. Call
+// BytesInit() once before anything else (more calls do nothing).
+//
+//      BytesInit();
+//
+//      BytesCRC crc;
+//      BytesCRCStart(crc, "crc32c");
+//      BytesCRCUpdate(crc, buff, len);         // as often as needed
+//      printf("%llx\n", (unsigned long long)BytesCRCValue(crc));
+//
+//      BytesConfig config;
+//      config.numColWidth = 16;
+//      config.numberFormat = BYTES_HEX_FORMAT;
+//      std::vector<char> text(BytesFormatSize(config, len));
+//      text.resize(BytesFormat(config, buff, len, &text[0], text.size()));
+//
+****************************************************************************/
+
+#ifndef LIBBYTES_H
+#define LIBBYTES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BYTES_DEF_NUM_COLS      20
+
+#define BYTES_DECIMAL_FORMAT    0
+#define BYTES_HEX_FORMAT        1
+
+/***************************************************************************
+   Public interface.
+***************************************************************************/
+
+// Detect the CPU and pick the fastest kernels it supports. Safe to call
+// from several threads; only the first call does anything.
+void BytesInit();
+
+// Layout of formatted rows (-w and -x of the command line tool)
+struct BytesConfig
+{
+    int         numColWidth;    // Bytes per row
+    int         numberFormat;   // BYTES_DECIMAL_FORMAT or BYTES_HEX_FORMAT
+
+    BytesConfig() : numColWidth(BYTES_DEF_NUM_COLS), numberFormat(BYTES_DECIMAL_FORMAT) {}
+};
+
+// The most chars BytesFormat() writes for len bytes
+size_t BytesFormatSize(const BytesConfig& config, size_t len);
+
+// Format len bytes of data as dump rows (a character line, a number line
+// and a blank line per config.numColWidth bytes, the last row possibly
+// short) into out. Returns the number of chars written, or 0 if outSz is
+// less than BytesFormatSize(config, len).
+size_t BytesFormat(const BytesConfig& config, const void* data, size_t len, char* out, size_t outSz);
+
+struct CRCAlgorithm;
+
+// A CRC being computed; feed it data in as many pieces as convenient
+struct BytesCRC
+{
+    const CRCAlgorithm* alg;
+    uint64_t            reg;
+};
+
+// Start a CRC: crc16, crc32 (the default if name is NULL), crc32c, crc64 or
+// crc64xz. Returns false if there is no CRC called name.
+bool BytesCRCStart(BytesCRC& crc, const char* name);
+void BytesCRCUpdate(BytesCRC& crc, const void* data, size_t len);
+
+// Feed in len zero bytes without reading them, e.g. for a hole in a file
+void BytesCRCZeros(BytesCRC& crc, long long len);
+
+// The CRC of everything fed in so far; more may still be fed in after
+uint64_t BytesCRCValue(const BytesCRC& crc);
+
+// The CRC of A followed by B from crc1 = CRC(A), crc2 = CRC(B) and the
+// length of B, for CRCs of pieces computed separately
+uint64_t BytesCRCCombine(const BytesCRC& crc, uint64_t crc1, uint64_t crc2, long long len2);
+
+#endif // LIBBYTES_H
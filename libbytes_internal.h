@@ -0,0 +1,173 @@
+/****************************************************************************
+// libbytes_internal.h -- the internals of libbytes shared with the bytes
+// command line tool and bytes_bench
+//
+// Copyright (c) 1995 - 018 Gerhard W. Gross.
+//
+// Distributed under the same terms as bytes.cpp; see the notice there.
+//
+// Not for programs that embed libbytes: these are the kernels, tables and
+// CPU feature flags behind libbytes.h, and may change between releases.
+//
+****************************************************************************/
+
+#ifndef LIBBYTES_INTERNAL_H
+#define LIBBYTES_INTERNAL_H
+
+#include "libbytes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BYTES_X86               1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define BYTES_ARM64             1
+#include <arm_neon.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+#endif
+
+// GCC and clang only emit instruction set extensions inside functions that
+// ask for them; MSVC always allows the intrinsics.
+#if defined(__GNUC__) || defined(__clang__)
+#define BYTES_TARGET(x)         __attribute__((target(x)))
+#else
+#define BYTES_TARGET(x)
+#endif
+
+// Every byte is shown as a cell this many characters wide
+#define BYTES_CELL_WIDTH        4
+
+/* CPU features detected by BytesInit(), used to pick kernels. */
+#if defined(BYTES_X86)
+extern bool g_cpuHasPclmul;
+extern bool g_cpuHasAvx2;
+extern bool g_cpuHasSse42;
+#elif defined(BYTES_ARM64)
+extern bool g_cpuHasArmCrc32;
+#endif
+
+void DetectCpuFeatures();
+
+/***************************************************************************
+   Read four or eight bytes as a little (or big) endian value regardless of
+   the byte order of this machine. Compilers reduce these to a single load
+   on matching targets.
+***************************************************************************/
+
+static inline uint32_t Load32LE(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t Load64LE(const unsigned char* p)
+{
+    return (uint64_t)Load32LE(p) | ((uint64_t)Load32LE(p + 4) << 32);
+}
+
+static inline uint64_t Load64BE(const unsigned char* p)
+{
+    uint64_t x = 0;
+
+    for (int i = 0; i < 8; i++)
+        x = (x << 8) | p[i];
+    return x;
+}
+
+/* CRC-32 kernels, slowest first. g_crc32Kernel is the one in use. */
+
+typedef uint32_t (*CRC32Kernel)(uint32_t crc, const unsigned char* buff, size_t len);
+
+struct CRC32KernelInfo
+{
+    const char*     name;
+    CRC32Kernel     func;
+    const bool*     available;  // NULL if always available
+};
+
+extern const CRC32KernelInfo g_crc32Kernels[];
+extern const int g_numCrc32Kernels;
+extern CRC32Kernel g_crc32Kernel;
+
+const CRC32KernelInfo* FindCRC32Kernel(const char* name);
+
+/* The CRCs that can be chosen with -a, and the calls that work on any of
+   them. */
+
+typedef uint64_t (*CRCUpdater)(uint64_t reg, const unsigned char* buff, size_t len);
+
+struct CRCAlgorithm
+{
+    const char*     name;
+    const char*     title;
+    int             width;
+    uint64_t        poly;
+    uint64_t        init;
+    bool            reflected;
+    uint64_t        xorOut;
+    CRCUpdater      update;
+};
+
+extern const CRCAlgorithm g_crcAlgorithms[];
+extern const int g_numCrcAlgorithms;
+
+const CRCAlgorithm* FindCRCAlgorithm(const char* name);
+uint64_t CRCInit(const CRCAlgorithm& alg);
+uint64_t CRCUpdate(const CRCAlgorithm& alg, uint64_t reg, const unsigned char* buff, size_t len);
+uint64_t CRCFinalize(const CRCAlgorithm& alg, uint64_t reg);
+uint64_t CRCShift(const CRCAlgorithm& alg, uint64_t reg, long long len);
+uint64_t CRCCombine(const CRCAlgorithm& alg, uint64_t crc1, uint64_t crc2, long long len2);
+
+/* Pre-rendered output cells and the cell renderers, slowest first.
+   g_cellKernel is the one in use. */
+
+extern char g_charCells[256][BYTES_CELL_WIDTH];
+extern char g_hexCells[256][BYTES_CELL_WIDTH];
+extern char g_decCells[256][BYTES_CELL_WIDTH];
+
+void MakeCellTables();
+
+typedef void (*CellRenderer)(const unsigned char* data, size_t n, char* out);
+
+struct CellKernelInfo
+{
+    const char*     name;
+    CellRenderer    chars;
+    CellRenderer    hex;
+    CellRenderer    dec;
+    const bool*     available;  // NULL if always available
+};
+
+extern const CellKernelInfo g_cellKernels[];
+extern const int g_numCellKernels;
+extern const CellKernelInfo* g_cellKernel;
+
+void SelectCellKernel();
+
+/***************************************************************************
+   Render one row of the dump, the character line then the number line,
+   for n bytes of data. out must have room for FormattedRowSize(n) chars.
+   Returns the number of chars written.
+***************************************************************************/
+
+static inline size_t FormattedRowSize(size_t n)
+{
+    return 2 * n * BYTES_CELL_WIDTH + 3;
+}
+
+size_t FormatRow(const BytesConfig& config, const unsigned char* data, size_t n, char* out);
+
+#endif // LIBBYTES_INTERNAL_H